@@ -17,6 +17,9 @@
  * Boston, MA 02110-1335, USA.
  */
 
+#include <string.h>
+#include <math.h>
+
 #include <gst/gst.h>
 #include <gst/audio/gstaudiosink.h>
 #include "gstbluetoothaudiosink.h"
@@ -64,11 +67,13 @@ static gboolean _audio_sink_acquire (GstBluetoothAudioSink *bluetoothaudiosink,
 
   g_mutex_lock (&bluetoothaudiosink->lock);
 
-  if ((state == BLUETOOTHAUDIOSINK_STATE_CONNECTED) || ((bluetoothaudiosink->acquired) && (state == BLUETOOTHAUDIOSINK_STATE_READY))) {
+  /* (Still STREAMING if a previous stop has not been processed by the service yet.) */
+  if ((state == BLUETOOTHAUDIOSINK_STATE_CONNECTED)
+        || ((bluetoothaudiosink->acquired) && ((state == BLUETOOTHAUDIOSINK_STATE_READY) || (state == BLUETOOTHAUDIOSINK_STATE_STREAMING)))) {
     bluetoothaudiosink->request_acquire = FALSE;
 
-    if ((bluetoothaudiosink->acquired)
-      && (sample_rate != bluetoothaudiosink->sample_rate) || ( bluetoothaudiosink->frame_rate != frame_rate) || (bluetoothaudiosink->bps != bps) || (bpf != bluetoothaudiosink->bpf)) {
+    if ((bluetoothaudiosink->acquired) && (sample_rate != 0)
+      && ((sample_rate != bluetoothaudiosink->sample_rate) || (bluetoothaudiosink->frame_rate != frame_rate) || (bluetoothaudiosink->bps != bps) || (bpf != bluetoothaudiosink->bpf))) {
 
       /* It is us still holding the lock, so release it. */
       if (bluetoothaudiosink_relinquish () != 0) {
@@ -110,7 +115,7 @@ static gboolean _audio_sink_acquire (GstBluetoothAudioSink *bluetoothaudiosink,
       result = TRUE;
       GST_INFO_OBJECT (bluetoothaudiosink, "Already acquired with same parameters...");
     }
-  } else if (postpone && ((state != BLUETOOTHAUDIOSINK_STATE_READY) || (state != BLUETOOTHAUDIOSINK_STATE_STREAMING))) {
+  } else if (postpone && ((state != BLUETOOTHAUDIOSINK_STATE_READY) && (state != BLUETOOTHAUDIOSINK_STATE_STREAMING))) {
     GST_INFO_OBJECT (bluetoothaudiosink, "Device not yet connected, will acquire it when it connects");
     bluetoothaudiosink->request_acquire = TRUE;
     result = TRUE;
@@ -160,6 +165,15 @@ static gboolean _audio_sink_start (GstBluetoothAudioSink *bluetoothaudiosink)
 
   g_mutex_lock (&bluetoothaudiosink->lock);
 
+  if ((state != BLUETOOTHAUDIOSINK_STATE_READY) && (!bluetoothaudiosink->playing)) {
+    /* Either not connected yet or a previous stop is still in progress; start once the device is READY. */
+    bluetoothaudiosink->request_playback = TRUE;
+
+    /* The device could have become READY meanwhile, with the callback finding nothing requested yet;
+       it can't slip in anymore now that the request is in place (and the lock held). */
+    bluetoothaudiosink_state (&state);
+  }
+
   if (state == BLUETOOTHAUDIOSINK_STATE_READY) {
     if (bluetoothaudiosink_speed (100) != 0) {
       GST_ERROR_OBJECT (bluetoothaudiosink, "bluetoothaudiosink_speed(100) failed");
@@ -167,9 +181,27 @@ static gboolean _audio_sink_start (GstBluetoothAudioSink *bluetoothaudiosink)
     } else {
       GST_INFO_OBJECT (bluetoothaudiosink, "Now streaming audio over Bluetooth!");
       bluetoothaudiosink->playing = TRUE;
+      bluetoothaudiosink->request_playback = FALSE;
+
+      if (bluetoothaudiosink->reconnected != 0) {
+        bluetoothaudiosink->resume_time = ((g_get_monotonic_time () - bluetoothaudiosink->reconnected) * GST_USECOND);
+
+        GST_INFO_OBJECT (bluetoothaudiosink, "Playback resumed %" GST_TIME_FORMAT " after reconnection", GST_TIME_ARGS (bluetoothaudiosink->resume_time));
+      }
+
+      bluetoothaudiosink->interrupted = FALSE;
+      bluetoothaudiosink->reconnected = 0;
+
+      /* Playback position reported by the service starts over. */
+      bluetoothaudiosink->latency.submitted = 0;
+      bluetoothaudiosink->latency.pending = FALSE;
+
+      /* Nothing to be continuous with, so the offset applies in full straight away. */
+      bluetoothaudiosink->latency.applied = bluetoothaudiosink->latency.offset;
+      bluetoothaudiosink->latency.slewed = g_get_monotonic_time ();
     }
-  } else if (state != BLUETOOTHAUDIOSINK_STATE_STREAMING) {
-    GST_INFO_OBJECT (bluetoothaudiosink, "Device not yet connected, will start playback once connected");
+  } else if (!bluetoothaudiosink->playing) {
+    GST_INFO_OBJECT (bluetoothaudiosink, "Device not ready yet, will start playback once it is");
   }
 
   g_mutex_unlock (&bluetoothaudiosink->lock);
@@ -189,8 +221,11 @@ static gboolean _audio_sink_stop (GstBluetoothAudioSink *bluetoothaudiosink)
   g_mutex_lock (&bluetoothaudiosink->lock);
 
   bluetoothaudiosink->request_playback = FALSE;
+  bluetoothaudiosink->interrupted = FALSE;
+  bluetoothaudiosink->reconnected = 0;
 
-  if (state == BLUETOOTHAUDIOSINK_STATE_STREAMING) {
+  /* (Could still be READY if the service has not processed the start yet.) */
+  if ((state == BLUETOOTHAUDIOSINK_STATE_STREAMING) || (bluetoothaudiosink->playing)) {
     if (bluetoothaudiosink_speed (0) != 0) {
       GST_ERROR_OBJECT( bluetoothaudiosink, "bluetoothaudiosink_speed(0) failed");
       result = FALSE;
@@ -220,14 +255,26 @@ static gint _audio_sink_frame (GstBluetoothAudioSink *bluetoothaudiosink, const
     /* This is a blocking call. */
     if (bluetoothaudiosink_frame (size, data, &played) != 0) {
       GST_ERROR_OBJECT( bluetoothaudiosink, "bluetoothaudiosink_frame() failed");
+      g_atomic_int_inc (&bluetoothaudiosink->write_errors);
     } else {
       result = played;
     }
+
+    g_mutex_lock (&bluetoothaudiosink->lock);
+
+    /* A reset meanwhile was for this write if it took everything, otherwise the write loop in audiosink
+       still needs it to get out (don't let it discard a later write either way). */
+    if ((result == (gint) size) && (bluetoothaudiosink->playing)) {
+      bluetoothaudiosink->request_reset = FALSE;
+    }
+
+    g_mutex_unlock (&bluetoothaudiosink->lock);
   } else {
     if (bluetoothaudiosink->request_reset) {
       /* A rather silly trick to ensure the write loop in audiosink is broken. */
       result = size;
       bluetoothaudiosink->request_reset = FALSE;
+      bluetoothaudiosink->discarded_bytes += size;
     }
 
     g_mutex_unlock (&bluetoothaudiosink->lock);
@@ -237,13 +284,33 @@ static gint _audio_sink_frame (GstBluetoothAudioSink *bluetoothaudiosink, const
   return result;
 }
 
-static guint _audio_sink_delay (GstBluetoothAudioSink *bluetoothaudiosink)
+#define LATENCY_OFFSET_MAX (10 * (gint64) GST_SECOND)
+#define LATENCY_SLEW (20) /* the applied offset changes by at most 1/20th of the time elapsed */
+
+/* Moves the applied latency offset towards the calibrated one gradually, so that the clock does not jump. */
+static gint64 _audio_sink_latency_slew (GstBluetoothAudioSinkLatency *latency)
 {
-  guint result = 0;
+  const gint64 now = g_get_monotonic_time ();
 
-  g_assert (bluetoothaudiosink != NULL);
+  if (latency->applied != latency->offset) {
+    const gint64 step = (((now - latency->slewed) * (gint64) GST_USECOND) / LATENCY_SLEW);
 
-  g_mutex_lock (&bluetoothaudiosink->lock);
+    if (latency->applied < latency->offset) {
+      latency->applied = MIN (latency->offset, (latency->applied + step));
+    } else {
+      latency->applied = MAX (latency->offset, (latency->applied - step));
+    }
+  }
+
+  latency->slewed = now;
+
+  return latency->applied;
+}
+
+/* Frames the service reports as queued ahead of the next write, or -1 if unknown. Call with the lock held. */
+static gint64 _audio_sink_reported_delay (GstBluetoothAudioSink *bluetoothaudiosink)
+{
+  gint64 result = -1;
 
   if (bluetoothaudiosink->playing) {
     uint32_t delay = 0;
@@ -255,6 +322,26 @@ static guint _audio_sink_delay (GstBluetoothAudioSink *bluetoothaudiosink)
     }
   }
 
+  return result;
+}
+
+static guint _audio_sink_delay (GstBluetoothAudioSink *bluetoothaudiosink)
+{
+  guint result = 0;
+
+  g_assert (bluetoothaudiosink != NULL);
+
+  g_mutex_lock (&bluetoothaudiosink->lock);
+
+  const gint64 frames = _audio_sink_reported_delay (bluetoothaudiosink);
+
+  if (frames >= 0) {
+    const gint64 offset = ((_audio_sink_latency_slew (&bluetoothaudiosink->latency) * bluetoothaudiosink->sample_rate) / (gint64) GST_SECOND);
+
+    /* Compensate for what calibration found the service to be off by on this device. */
+    result = (guint) MAX (0, (frames + offset));
+  }
+
   g_mutex_unlock (&bluetoothaudiosink->lock);
 
   return result;
@@ -269,6 +356,287 @@ static void _audio_sink_reset (GstBluetoothAudioSink *bluetoothaudiosink)
   g_mutex_unlock (&bluetoothaudiosink->lock);
 }
 
+static void _audio_sink_statistics_reset (GstBluetoothAudioSink *bluetoothaudiosink)
+{
+  g_mutex_lock (&bluetoothaudiosink->lock);
+
+  g_atomic_int_set (&bluetoothaudiosink->write_errors, 0);
+  bluetoothaudiosink->discarded_bytes = 0;
+  bluetoothaudiosink->resume_time = GST_CLOCK_TIME_NONE;
+
+  g_mutex_unlock (&bluetoothaudiosink->lock);
+}
+
+/* level metering */
+
+#define LEVEL_INTERVAL_DEFAULT (100 * GST_MSECOND)
+
+/* Decaying peak behaviour, as per the defaults of the level element. */
+#define LEVEL_PEAK_TTL (3 * GST_SECOND / 10)
+#define LEVEL_PEAK_FALLOFF (10.0) /* dB per second */
+
+#define LEVEL_BOUNCE_SAMPLES (256)
+
+static void _audio_sink_level_clear (GstBluetoothAudioSinkLevel *level)
+{
+  level->frames = 0;
+
+  memset (level->sum, 0, sizeof (level->sum));
+  memset (level->peak, 0, sizeof (level->peak));
+}
+
+static void _audio_sink_level_reset (GstBluetoothAudioSinkLevel *level, const guint channels)
+{
+  guint c;
+
+  _audio_sink_level_clear (level);
+
+  level->channels = channels;
+  level->partial_size = 0;
+
+  for (c = 0; c < GST_BLUETOOTHAUDIOSINK_MAX_CHANNELS; c++) {
+    level->decay[c] = -INFINITY;
+    level->decay_base[c] = -INFINITY;
+    level->decay_age[c] = 0;
+  }
+}
+
+/* Lane i accumulates samples i, i + LANES, i + 2 * LANES, ..., which keeps the loop vectorisable.
+   Every run starts on a frame boundary, so lane i always holds channel (i % channels). */
+static void _audio_sink_level_accumulate (GstBluetoothAudioSinkLevel *level, const gint16 * restrict samples, const guint count)
+{
+  const guint blocks = (count / GST_BLUETOOTHAUDIOSINK_LEVEL_LANES);
+  gint64 sum[GST_BLUETOOTHAUDIOSINK_LEVEL_LANES];
+  gint32 peak[GST_BLUETOOTHAUDIOSINK_LEVEL_LANES];
+  guint i, j;
+
+  /* (Working on local copies lets the compiler keep the lanes in registers.) */
+  memcpy (sum, level->sum, sizeof (sum));
+  memcpy (peak, level->peak, sizeof (peak));
+
+  for (i = 0; i < blocks; i++) {
+    for (j = 0; j < GST_BLUETOOTHAUDIOSINK_LEVEL_LANES; j++) {
+      const gint32 sample = samples[(i * GST_BLUETOOTHAUDIOSINK_LEVEL_LANES) + j];
+
+      sum[j] += (sample * sample);
+      peak[j] = MAX (peak[j], ABS (sample));
+    }
+  }
+
+  for (j = 0, i = (blocks * GST_BLUETOOTHAUDIOSINK_LEVEL_LANES); i < count; i++, j++) {
+    const gint32 sample = samples[i];
+
+    sum[j] += (sample * sample);
+    peak[j] = MAX (peak[j], ABS (sample));
+  }
+
+  memcpy (level->sum, sum, sizeof (sum));
+  memcpy (level->peak, peak, sizeof (peak));
+}
+
+/* Meters a run of bytes that need not start or end on a frame boundary, nor be aligned. */
+static void _audio_sink_level_feed (GstBluetoothAudioSinkLevel *level, const guint8 *data, guint size, const guint bpf)
+{
+  const guint channels = level->channels;
+
+  if (level->partial_size != 0) {
+    /* Complete the frame the previous write ended in the middle of. */
+    const guint count = MIN ((bpf - level->partial_size), size);
+
+    memcpy (((guint8 *) level->partial + level->partial_size), data, count);
+    level->partial_size += count;
+    data += count;
+    size -= count;
+
+    if (level->partial_size == bpf) {
+      _audio_sink_level_accumulate (level, level->partial, channels);
+      level->frames++;
+      level->partial_size = 0;
+    }
+  }
+
+  if (level->partial_size == 0) {
+    const guint frames = (size / bpf);
+
+    if ((((guintptr) data) % sizeof (gint16)) == 0) {
+      _audio_sink_level_accumulate (level, (const gint16 *) data, (frames * channels));
+    } else {
+      /* Follows an odd-sized write, so go through an aligned copy. */
+      const guint chunk = (LEVEL_BOUNCE_SAMPLES / channels);
+      gint16 bounce[LEVEL_BOUNCE_SAMPLES];
+      guint done = 0;
+
+      while (done < frames) {
+        const guint count = MIN (chunk, (frames - done));
+
+        memcpy (bounce, (data + (done * bpf)), (count * bpf));
+        _audio_sink_level_accumulate (level, bounce, (count * channels));
+        done += count;
+      }
+    }
+
+    level->frames += frames;
+    level->partial_size = (size - (frames * bpf));
+
+    memcpy (level->partial, (data + (frames * bpf)), level->partial_size);
+  }
+}
+
+static void _audio_sink_level_take_array (GstStructure *structure, const gchar *name, GValueArray *array)
+{
+  GValue value = G_VALUE_INIT;
+
+  /* As the level element does it, so that the fields are GValueArrays as applications expect. */
+  G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
+  g_value_init (&value, G_TYPE_VALUE_ARRAY);
+  G_GNUC_END_IGNORE_DEPRECATIONS;
+
+  g_value_take_boxed (&value, array);
+  gst_structure_take_value (structure, name, &value);
+}
+
+static void _audio_sink_level_post (GstBluetoothAudioSink *bluetoothaudiosink, const guint sample_rate)
+{
+  GstBluetoothAudioSinkLevel *level = &bluetoothaudiosink->level;
+  const GstClockTime duration = gst_util_uint64_scale_int (level->frames, GST_SECOND, sample_rate);
+  const GstClockTime delay = gst_util_uint64_scale_int (_audio_sink_delay (bluetoothaudiosink), GST_SECOND, sample_rate);
+  GstClockTime endtime = GST_CLOCK_TIME_NONE;
+  GstClockTime running_time = GST_CLOCK_TIME_NONE;
+  GstClockTime timestamp = GST_CLOCK_TIME_NONE;
+  GstClockTime stream_time = GST_CLOCK_TIME_NONE;
+  GstClock *clock = gst_element_get_clock (GST_ELEMENT (bluetoothaudiosink));
+  GstStructure *structure = NULL;
+  GValueArray *rms = NULL;
+  GValueArray *peak = NULL;
+  GValueArray *decay = NULL;
+  GValue value = G_VALUE_INIT;
+  guint c, j;
+
+  if (clock != NULL) {
+    const GstClockTime now = gst_clock_get_time (clock);
+    const GstClockTime base_time = gst_element_get_base_time (GST_ELEMENT (bluetoothaudiosink));
+
+    /* The last metered frame is heard once the device has played out its queue. */
+    if (now >= base_time) {
+      endtime = ((now - base_time) + delay);
+      running_time = ((endtime > duration)? (endtime - duration) : 0);
+    }
+
+    gst_object_unref (clock);
+  }
+
+  if (GST_CLOCK_TIME_IS_VALID (running_time)) {
+    GstSegment *segment = &GST_BASE_SINK (bluetoothaudiosink)->segment;
+
+    GST_OBJECT_LOCK (bluetoothaudiosink);
+
+#if GST_CHECK_VERSION(1, 8, 0)
+    timestamp = gst_segment_position_from_running_time (segment, GST_FORMAT_TIME, running_time);
+#else
+    timestamp = gst_segment_to_position (segment, GST_FORMAT_TIME, running_time);
+#endif
+    stream_time = gst_segment_to_stream_time (segment, GST_FORMAT_TIME, timestamp);
+
+    GST_OBJECT_UNLOCK (bluetoothaudiosink);
+  }
+
+  G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
+  rms = g_value_array_new (level->channels);
+  peak = g_value_array_new (level->channels);
+  decay = g_value_array_new (level->channels);
+  G_GNUC_END_IGNORE_DEPRECATIONS;
+
+  g_value_init (&value, G_TYPE_DOUBLE);
+
+  for (c = 0; c < level->channels; c++) {
+    gint64 sum = 0;
+    gint32 max = 0;
+
+    for (j = c; j < GST_BLUETOOTHAUDIOSINK_LEVEL_LANES; j += level->channels) {
+      sum += level->sum[j];
+      max = MAX (max, level->peak[j]);
+    }
+
+    const gdouble rms_db = (10.0 * log10 ((gdouble) sum / ((gdouble) level->frames * 32768.0 * 32768.0)));
+    const gdouble peak_db = (20.0 * log10 ((gdouble) max / 32768.0));
+
+    if (peak_db >= level->decay[c]) {
+      level->decay[c] = peak_db;
+      level->decay_base[c] = peak_db;
+      level->decay_age[c] = 0;
+    } else {
+      level->decay_age[c] += duration;
+
+      if (level->decay_age[c] > LEVEL_PEAK_TTL) {
+        const gdouble falloff = ((LEVEL_PEAK_FALLOFF * (level->decay_age[c] - LEVEL_PEAK_TTL)) / GST_SECOND);
+
+        level->decay[c] = MAX (peak_db, (level->decay_base[c] - falloff));
+      }
+    }
+
+    G_GNUC_BEGIN_IGNORE_DEPRECATIONS;
+    g_value_set_double (&value, rms_db);
+    g_value_array_append (rms, &value);
+    g_value_set_double (&value, peak_db);
+    g_value_array_append (peak, &value);
+    g_value_set_double (&value, level->decay[c]);
+    g_value_array_append (decay, &value);
+    G_GNUC_END_IGNORE_DEPRECATIONS;
+  }
+
+  g_value_unset (&value);
+
+  /* Same layout as the messages of the level element, with the times referring to when the audio is heard. */
+  structure = gst_structure_new ("level",
+                                 "timestamp", G_TYPE_UINT64, timestamp,
+                                 "stream-time", G_TYPE_UINT64, stream_time,
+                                 "running-time", G_TYPE_UINT64, running_time,
+                                 "duration", G_TYPE_UINT64, duration,
+                                 "endtime", G_TYPE_UINT64, endtime,
+                                 NULL);
+
+  _audio_sink_level_take_array (structure, "rms", rms);
+  _audio_sink_level_take_array (structure, "peak", peak);
+  _audio_sink_level_take_array (structure, "decay", decay);
+
+  gst_element_post_message (GST_ELEMENT (bluetoothaudiosink), gst_message_new_element (GST_OBJECT (bluetoothaudiosink), structure));
+}
+
+static void _audio_sink_level (GstBluetoothAudioSink *bluetoothaudiosink, const gpointer data, const guint size)
+{
+  GstBluetoothAudioSinkLevel *level = &bluetoothaudiosink->level;
+
+  g_assert (bluetoothaudiosink != NULL);
+
+  g_mutex_lock (&bluetoothaudiosink->lock);
+
+  const gboolean enabled = (level->enabled && bluetoothaudiosink->playing);
+  const GstClockTime interval = level->interval;
+  const guint sample_rate = bluetoothaudiosink->sample_rate;
+  const guint channels = bluetoothaudiosink->channels;
+  const guint bpf = bluetoothaudiosink->bpf;
+
+  g_mutex_unlock (&bluetoothaudiosink->lock);
+
+  if (!enabled) {
+    if ((level->frames != 0) || (level->partial_size != 0)) {
+      /* Start afresh next time. */
+      _audio_sink_level_reset (level, channels);
+    }
+  } else {
+    if (level->channels != channels) {
+      _audio_sink_level_reset (level, channels);
+    }
+
+    _audio_sink_level_feed (level, (const guint8 *) data, size, bpf);
+
+    if ((level->frames != 0) && (level->frames >= gst_util_uint64_scale_int_ceil (interval, sample_rate, GST_SECOND))) {
+      _audio_sink_level_post (bluetoothaudiosink, sample_rate);
+      _audio_sink_level_clear (level);
+    }
+  }
+}
+
 static void _audio_sink_callback_connected (void *user_data)
 {
   GstBluetoothAudioSink *bluetoothaudiosink = (GstBluetoothAudioSink*)user_data;
@@ -280,6 +648,10 @@ static void _audio_sink_callback_connected (void *user_data)
   const gboolean acquire = bluetoothaudiosink->request_acquire;
   const gboolean playback = bluetoothaudiosink->request_playback;
 
+  if ((bluetoothaudiosink->interrupted) && (bluetoothaudiosink->reconnected == 0)) {
+    bluetoothaudiosink->reconnected = g_get_monotonic_time ();
+  }
+
   g_mutex_unlock (&bluetoothaudiosink->lock);
 
   if (acquire) {
@@ -299,6 +671,26 @@ static void _audio_sink_callback_connected (void *user_data)
   }
 }
 
+static void _audio_sink_callback_ready (void *user_data)
+{
+  GstBluetoothAudioSink *bluetoothaudiosink = (GstBluetoothAudioSink*)user_data;
+
+  g_assert (bluetoothaudiosink != NULL);
+
+  g_mutex_lock (&bluetoothaudiosink->lock);
+
+  const gboolean playback = ((bluetoothaudiosink->request_playback) && (bluetoothaudiosink->acquired));
+
+  g_mutex_unlock (&bluetoothaudiosink->lock);
+
+  /* Playback was requested while the device was still on its way to READY. */
+  if (playback) {
+    if (!_audio_sink_start (bluetoothaudiosink)) {
+      GST_ERROR_OBJECT (bluetoothaudiosink, "Failed to start playback on the Bluetooth audio sink device!");
+    }
+  }
+}
+
 static void _audio_sink_callback_disconnected (void *user_data)
 {
   GstBluetoothAudioSink *bluetoothaudiosink = (GstBluetoothAudioSink*)user_data;
@@ -312,11 +704,20 @@ static void _audio_sink_callback_disconnected (void *user_data)
     bluetoothaudiosink->request_playback = TRUE;
   }
 
+  if (bluetoothaudiosink->request_playback) {
+    /* To tell how long it takes to get back to playing once reconnected. */
+    bluetoothaudiosink->interrupted = TRUE;
+    bluetoothaudiosink->reconnected = 0;
+  }
+
   if (bluetoothaudiosink->acquired) {
     bluetoothaudiosink->acquired = FALSE;
     bluetoothaudiosink->request_acquire = TRUE;
   }
 
+  /* The playback position will start over, so a marker in flight can't be matched anymore. */
+  bluetoothaudiosink->latency.pending = FALSE;
+
   g_mutex_unlock (&bluetoothaudiosink->lock);
 }
 
@@ -349,6 +750,7 @@ static void _audio_sink_callback_state_changed (const bluetoothaudiosink_state_t
     break;
   case BLUETOOTHAUDIOSINK_STATE_READY:
     GST_INFO_OBJECT (bluetoothaudiosink, "Bluetooth Audio sink now ready!");
+    _audio_sink_callback_ready (bluetoothaudiosink);
     break;
   case BLUETOOTHAUDIOSINK_STATE_STREAMING:
     GST_INFO_OBJECT (bluetoothaudiosink, "Bluetooth Audio sink is now streaming!");
@@ -380,11 +782,689 @@ static void _audio_sink_callback_operational_state_updated (const uint8_t runnin
   }
 }
 
+/* latency calibration */
+
+/* A marker is just a frame position: the sink notes when the frame at that position is handed over,
+   and then waits for the playback position reported by the service to pass it. */
+#define LATENCY_MARKER_INTERVAL (2 * G_USEC_PER_SEC)
+#define LATENCY_MARKER_TIMEOUT (5 * G_USEC_PER_SEC)
+#define LATENCY_POLL_INTERVAL (G_USEC_PER_SEC / 50) /* the playback position is queried at most this often */
+#define LATENCY_BATCH (5) /* measurements averaged before the offset is updated */
+
+static gboolean _audio_sink_latency_mark (GstBluetoothAudioSink *bluetoothaudiosink)
+{
+  GstBluetoothAudioSinkLatency *latency = &bluetoothaudiosink->latency;
+  gboolean result = FALSE;
+
+  g_assert (bluetoothaudiosink != NULL);
+
+  g_mutex_lock (&bluetoothaudiosink->lock);
+
+  if ((latency->calibrate) && (bluetoothaudiosink->playing) && (!latency->pending) && (g_get_monotonic_time () >= latency->next)) {
+    result = TRUE;
+  }
+
+  g_mutex_unlock (&bluetoothaudiosink->lock);
+
+  return result;
+}
+
+static void _audio_sink_latency_post (GstBluetoothAudioSink *bluetoothaudiosink, const GstClockTime measured, const GstClockTime expected, const gint64 offset)
+{
+  GstStructure *structure = gst_structure_new ("latency-calibration",
+                                               "measured", G_TYPE_UINT64, measured,
+                                               "expected", G_TYPE_UINT64, expected,
+                                               "offset", G_TYPE_INT64, offset,
+                                               NULL);
+
+  gst_element_post_message (GST_ELEMENT (bluetoothaudiosink), gst_message_new_element (GST_OBJECT (bluetoothaudiosink), structure));
+}
+
+static void _audio_sink_latency_update (GstBluetoothAudioSink *bluetoothaudiosink, const gboolean marked, const gint size)
+{
+  GstBluetoothAudioSinkLatency *latency = &bluetoothaudiosink->latency;
+
+  g_assert (bluetoothaudiosink != NULL);
+
+  g_mutex_lock (&bluetoothaudiosink->lock);
+
+  const guint sample_rate = bluetoothaudiosink->sample_rate;
+  const guint bpf = bluetoothaudiosink->bpf;
+  const guint64 frames = ((size > 0)? (size / bpf) : 0);
+
+  /* Count bytes, as writes need not end on a frame boundary; the marked frame is the first one starting in this write. */
+  const guint64 position = ((latency->submitted + bpf - 1) / bpf);
+
+  latency->submitted += ((size > 0)? size : 0);
+
+  if ((!latency->calibrate) || (!bluetoothaudiosink->playing)) {
+    latency->pending = FALSE;
+  }
+
+  const gint64 now = g_get_monotonic_time ();
+  const gboolean pending = ((latency->pending) && ((now - latency->polled) >= LATENCY_POLL_INTERVAL));
+
+  if (pending) {
+    latency->polled = now;
+  }
+
+  g_mutex_unlock (&bluetoothaudiosink->lock);
+
+  if (marked && (frames != 0)) {
+    GstClockTime expected = GST_CLOCK_TIME_NONE;
+
+    g_mutex_lock (&bluetoothaudiosink->lock);
+
+    const gint64 reported = _audio_sink_reported_delay (bluetoothaudiosink);
+
+    if (reported >= 0) {
+      /* The marker leads this frame, so it is played out once everything queued ahead of this frame is.
+         Expect it against the target offset rather than the one still slewing towards it, otherwise
+         the part of the last correction not yet applied is counted as error again. */
+      const gint64 delay = ((reported + ((latency->offset * sample_rate) / (gint64) GST_SECOND)) - (gint64) frames);
+
+      expected = gst_util_uint64_scale_int (MAX (0, delay), GST_SECOND, sample_rate);
+
+      latency->pending = TRUE;
+      latency->marker = position;
+      latency->marked = now;
+      latency->polled = now;
+      latency->expected = expected;
+    }
+
+    g_mutex_unlock (&bluetoothaudiosink->lock);
+
+    if (GST_CLOCK_TIME_IS_VALID (expected)) {
+      GST_DEBUG_OBJECT (bluetoothaudiosink, "Latency marker at frame %" G_GUINT64_FORMAT ", expected after %" GST_TIME_FORMAT,
+                        position, GST_TIME_ARGS (expected));
+    }
+  } else if (pending) {
+    uint32_t time = 0;
+    const uint32_t status = bluetoothaudiosink_time (&time);
+    const guint64 played = (((guint64) time * sample_rate) / 1000);
+    const gint64 queried = g_get_monotonic_time ();
+    GstClockTime measured = GST_CLOCK_TIME_NONE;
+    GstClockTime expected = GST_CLOCK_TIME_NONE;
+    gboolean failed = FALSE;
+    gboolean expired = FALSE;
+    gboolean updated = FALSE;
+
+    g_mutex_lock (&bluetoothaudiosink->lock);
+
+    /* (Could have been cleared by a disconnection meanwhile.) */
+    if (latency->pending) {
+      if (status != 0) {
+        failed = TRUE;
+      } else if (played >= latency->marker) {
+        /* The service has played past the marker; work out when exactly it went out. */
+        const gint64 heard = (queried - (gint64) gst_util_uint64_scale_int ((played - latency->marker), G_USEC_PER_SEC, sample_rate));
+
+        measured = ((heard > latency->marked)? ((heard - latency->marked) * GST_USECOND) : 0);
+        expected = latency->expected;
+
+        latency->error += ((gint64) measured - (gint64) expected);
+        latency->measurements++;
+
+        if (latency->measurements == LATENCY_BATCH) {
+          latency->offset = CLAMP ((latency->offset + (latency->error / LATENCY_BATCH)), -LATENCY_OFFSET_MAX, LATENCY_OFFSET_MAX);
+          latency->error = 0;
+          latency->measurements = 0;
+          updated = TRUE;
+        }
+      } else if ((queried - latency->marked) > LATENCY_MARKER_TIMEOUT) {
+        expired = TRUE;
+      }
+
+      if (failed || expired || GST_CLOCK_TIME_IS_VALID (measured)) {
+        latency->pending = FALSE;
+        latency->next = (queried + LATENCY_MARKER_INTERVAL);
+      }
+    }
+
+    const gint64 offset = latency->offset;
+
+    g_mutex_unlock (&bluetoothaudiosink->lock);
+
+    if (failed) {
+      GST_WARNING_OBJECT (bluetoothaudiosink, "bluetoothaudiosink_time() failed, latency marker abandoned");
+    } else if (expired) {
+      GST_WARNING_OBJECT (bluetoothaudiosink, "Playback position did not reach the latency marker in time, marker abandoned");
+    } else if (GST_CLOCK_TIME_IS_VALID (measured)) {
+      GST_DEBUG_OBJECT (bluetoothaudiosink, "Latency marker played out after %" GST_TIME_FORMAT ", expected %" GST_TIME_FORMAT,
+                        GST_TIME_ARGS (measured), GST_TIME_ARGS (expected));
+
+      _audio_sink_latency_post (bluetoothaudiosink, measured, expected, offset);
+
+      if (updated) {
+        GST_INFO_OBJECT (bluetoothaudiosink, "Latency offset for this device is now %" G_GINT64_FORMAT "ns", offset);
+        g_object_notify (G_OBJECT (bluetoothaudiosink), "latency-offset");
+      }
+    }
+  }
+}
+
+/* time-stretching */
+
+/* Segment rates within this range are played back at the original pitch. */
+#define STRETCH_RATE_MIN (0.5)
+#define STRETCH_RATE_MAX (2.0)
+
+#define STRETCH_STRIDE_MS (30)
+#define STRETCH_OVERLAP_PERCENT (20)
+#define STRETCH_SEARCH_MS (14)
+
+/* How often the stretching cost is reported, in seconds of output. */
+#define STRETCH_REPORT_INTERVAL (10)
+
+/* The kernels below operate on flat runs of interleaved samples, so that the compiler can vectorise them. */
+
+static void _audio_sink_stretch_window (gint16 * restrict output, const gint16 * restrict input, const gint32 * restrict shape, const guint count)
+{
+  guint i;
+
+  for (i = 0; i < count; i++) {
+    output[i] = (gint16) ((input[i] * shape[i]) >> 15);
+  }
+}
+
+/* Products are scaled down so that the sum fits 32 bits for up to 48 kHz stereo, which keeps the vectors wide. */
+static gint32 _audio_sink_stretch_correlate (const gint16 * restrict a, const gint16 * restrict b, const guint count)
+{
+  gint32 sum = 0;
+  guint i;
+
+  for (i = 0; i < count; i++) {
+    sum += ((a[i] * b[i]) >> 10);
+  }
+
+  return sum;
+}
+
+static void _audio_sink_stretch_blend (gint16 * restrict output, const gint16 * restrict from, const gint16 * restrict to, const gint32 * restrict blend, const guint count)
+{
+  guint i;
+
+  for (i = 0; i < count; i++) {
+    output[i] = (gint16) (((from[i] * (32768 - blend[i])) + (to[i] * blend[i])) >> 15);
+  }
+}
+
+static void _audio_sink_stretch_flush (GstBluetoothAudioSinkStretch *stretch)
+{
+  stretch->queued = 0;
+  stretch->skip = 0;
+  stretch->hop_error = 0.0;
+  stretch->primed = FALSE;
+  stretch->discont = TRUE;
+  stretch->timestamp = GST_CLOCK_TIME_NONE;
+  stretch->offset = 0;
+}
+
+static void _audio_sink_stretch_free (GstBluetoothAudioSinkStretch *stretch)
+{
+  g_free (stretch->queue);
+  g_free (stretch->tail);
+  g_free (stretch->window);
+  g_free (stretch->blend);
+  g_free (stretch->shape);
+
+  stretch->queue = NULL;
+  stretch->tail = NULL;
+  stretch->window = NULL;
+  stretch->blend = NULL;
+  stretch->shape = NULL;
+}
+
+static void _audio_sink_stretch_configure (GstBluetoothAudioSinkStretch *stretch, const guint sample_rate, const guint channels)
+{
+  if ((stretch->queue == NULL) || (stretch->sample_rate != sample_rate) || (stretch->channels != channels)) {
+    guint i, c;
+
+    _audio_sink_stretch_free (stretch);
+
+    stretch->sample_rate = sample_rate;
+    stretch->channels = channels;
+    stretch->stride = ((sample_rate * STRETCH_STRIDE_MS) / 1000);
+    stretch->overlap = ((stretch->stride * STRETCH_OVERLAP_PERCENT) / 100);
+    stretch->search = ((sample_rate * STRETCH_SEARCH_MS) / 1000);
+
+    stretch->queue = g_new (gint16, ((stretch->search + stretch->stride + stretch->overlap) * channels));
+    stretch->tail = g_new (gint16, (stretch->overlap * channels));
+    stretch->window = g_new (gint16, (stretch->overlap * channels));
+    stretch->blend = g_new (gint32, (stretch->overlap * channels));
+    stretch->shape = g_new (gint32, (stretch->overlap * channels));
+
+    for (i = 0; i < stretch->overlap; i++) {
+      /* Linear crossfade, and a parabolic window to favour matches in the middle of the overlap. */
+      const gint32 blend = ((i * 32768) / stretch->overlap);
+      const gint32 shape = (((guint64) 4 * i * (stretch->overlap - i) * 32768) / ((guint64) stretch->overlap * stretch->overlap));
+
+      for (c = 0; c < channels; c++) {
+        stretch->blend[(i * channels) + c] = blend;
+        stretch->shape[(i * channels) + c] = shape;
+      }
+    }
+  }
+
+  _audio_sink_stretch_flush (stretch);
+}
+
+/* Emits one stride of output from a full queue. */
+static guint _audio_sink_stretch_iterate (GstBluetoothAudioSinkStretch *stretch, gint16 *output)
+{
+  const guint channels = stretch->channels;
+  guint offset = 0;
+
+  if (!stretch->primed) {
+    /* Nothing to splice onto yet. */
+    memcpy (output, stretch->queue, (stretch->stride * channels * sizeof (gint16)));
+    stretch->primed = TRUE;
+  } else {
+    gint32 best = G_MININT32;
+    guint i;
+
+    /* Find where the queued input best continues what has been output so far... */
+    _audio_sink_stretch_window (stretch->window, stretch->tail, stretch->shape, (stretch->overlap * channels));
+
+    for (i = 0; i < stretch->search; i++) {
+      const gint32 correlation = _audio_sink_stretch_correlate (stretch->window, (stretch->queue + (i * channels)), (stretch->overlap * channels));
+
+      if (correlation > best) {
+        best = correlation;
+        offset = i;
+      }
+    }
+
+    /* ...and splice it in there. */
+    _audio_sink_stretch_blend (output, stretch->tail, (stretch->queue + (offset * channels)), stretch->blend, (stretch->overlap * channels));
+
+    memcpy ((output + (stretch->overlap * channels)), (stretch->queue + ((offset + stretch->overlap) * channels)),
+            ((stretch->stride - stretch->overlap) * channels * sizeof (gint16)));
+  }
+
+  memcpy (stretch->tail, (stretch->queue + ((offset + stretch->stride) * channels)), (stretch->overlap * channels * sizeof (gint16)));
+
+  return stretch->stride;
+}
+
+/* Moves the queue forward by one stride scaled by the playback rate. */
+static void _audio_sink_stretch_advance (GstBluetoothAudioSinkStretch *stretch)
+{
+  const gdouble hop = ((stretch->stride * stretch->rate) + stretch->hop_error);
+  const guint frames = (guint) hop;
+
+  stretch->hop_error = (hop - frames);
+
+  if (frames < stretch->queued) {
+    memmove (stretch->queue, (stretch->queue + (frames * stretch->channels)), ((stretch->queued - frames) * stretch->channels * sizeof (gint16)));
+    stretch->queued -= frames;
+  } else {
+    stretch->skip = (frames - stretch->queued);
+    stretch->queued = 0;
+  }
+}
+
+/* Returns the most output frames that the given number of input frames can produce. */
+static guint _audio_sink_stretch_capacity (const GstBluetoothAudioSinkStretch *stretch, const guint frames)
+{
+  const guint hop = MAX (1, (guint) (stretch->stride * stretch->rate));
+
+  return ((((stretch->queued + frames) / hop) + 1) * stretch->stride);
+}
+
+static guint _audio_sink_stretch_process (GstBluetoothAudioSinkStretch *stretch, const gint16 *input, guint frames, gint16 *output)
+{
+  const guint channels = stretch->channels;
+  const guint size = (stretch->search + stretch->stride + stretch->overlap);
+  guint produced = 0;
+
+  while (TRUE) {
+    guint count;
+
+    if (stretch->skip != 0) {
+      if (frames == 0) {
+        break;
+      }
+
+      count = MIN (stretch->skip, frames);
+      input += (count * channels);
+      frames -= count;
+      stretch->skip -= count;
+      continue;
+    }
+
+    count = MIN ((size - stretch->queued), frames);
+    memcpy ((stretch->queue + (stretch->queued * channels)), input, (count * channels * sizeof (gint16)));
+    stretch->queued += count;
+    input += (count * channels);
+    frames -= count;
+
+    if (stretch->queued < size) {
+      break;
+    }
+
+    produced += _audio_sink_stretch_iterate (stretch, (output + (produced * channels)));
+
+    _audio_sink_stretch_advance (stretch);
+  }
+
+  return produced;
+}
+
+/* Maps an upstream timestamp onto the normalised (rate 1.0) segment. */
+static GstClockTime _audio_sink_stretch_time (const GstBluetoothAudioSinkStretch *stretch, const GstClockTime time)
+{
+  GstClockTime result = time;
+
+  if (GST_CLOCK_TIME_IS_VALID (time) && (time > stretch->segment.start)) {
+    result = (stretch->segment.start + (GstClockTime) ((time - stretch->segment.start) / stretch->rate));
+  }
+
+  return result;
+}
+
+static GstEvent* _audio_sink_stretch_segment (GstBluetoothAudioSink *bluetoothaudiosink, GstEvent *event)
+{
+  GstBluetoothAudioSinkStretch *stretch = &bluetoothaudiosink->stretch;
+  const GstSegment *segment = NULL;
+  GstEvent *result = event;
+
+  gst_event_parse_segment (event, &segment);
+
+  _audio_sink_stretch_flush (stretch);
+
+  stretch->active = ((segment->format == GST_FORMAT_TIME) && (segment->rate != 1.0)
+                      && (segment->rate >= STRETCH_RATE_MIN) && (segment->rate <= STRETCH_RATE_MAX) && (stretch->queue != NULL));
+
+  if (stretch->active) {
+    GstSegment normalised;
+
+    gst_segment_copy_into (segment, &stretch->segment);
+    stretch->rate = segment->rate;
+
+    /* Downstream sees a rate 1.0 segment, with the rate applied by us. */
+    gst_segment_copy_into (segment, &normalised);
+    normalised.rate = 1.0;
+    normalised.applied_rate = (segment->applied_rate * segment->rate);
+    normalised.stop = _audio_sink_stretch_time (stretch, segment->stop);
+    normalised.position = _audio_sink_stretch_time (stretch, segment->position);
+
+    result = gst_event_new_segment (&normalised);
+    gst_event_set_seqnum (result, gst_event_get_seqnum (event));
+    gst_event_unref (event);
+
+    GST_INFO_OBJECT (bluetoothaudiosink, "Time-stretching playback at %.2fx", stretch->rate);
+  } else if (segment->rate != 1.0) {
+    GST_WARNING_OBJECT (bluetoothaudiosink, "Playback rate %.2f not supported for time-stretching", segment->rate);
+  }
+
+  return result;
+}
+
+/* Stamps and trims a buffer holding the given number of freshly stretched frames. */
+static GstBuffer* _audio_sink_stretch_output (GstBluetoothAudioSinkStretch *stretch, GstBuffer *buffer, const guint produced)
+{
+  GstBuffer *result = NULL;
+
+  if (produced == 0) {
+    gst_buffer_unref (buffer);
+  } else {
+    result = buffer;
+
+    gst_buffer_resize (result, 0, (produced * stretch->channels * sizeof (gint16)));
+
+    if (GST_CLOCK_TIME_IS_VALID (stretch->timestamp)) {
+      const GstClockTime begin = gst_util_uint64_scale_int (stretch->offset, GST_SECOND, stretch->sample_rate);
+      const GstClockTime end = gst_util_uint64_scale_int ((stretch->offset + produced), GST_SECOND, stretch->sample_rate);
+
+      GST_BUFFER_PTS (result) = (stretch->timestamp + begin);
+      GST_BUFFER_DURATION (result) = (end - begin);
+    }
+
+    if (stretch->discont) {
+      GST_BUFFER_FLAG_SET (result, GST_BUFFER_FLAG_DISCONT);
+      stretch->discont = FALSE;
+    }
+
+    stretch->offset += produced;
+    stretch->produced += produced;
+  }
+
+  return result;
+}
+
+static void _audio_sink_stretch_account (GstBluetoothAudioSink *bluetoothaudiosink, const gint64 start)
+{
+  GstBluetoothAudioSinkStretch *stretch = &bluetoothaudiosink->stretch;
+
+  stretch->cost += (g_get_monotonic_time () - start);
+
+  if (stretch->produced >= (stretch->sample_rate * STRETCH_REPORT_INTERVAL)) {
+    GST_DEBUG_OBJECT (bluetoothaudiosink, "Time-stretching at %.2fx costs %" G_GUINT64_FORMAT "us per second of output",
+                      stretch->rate, ((stretch->cost * stretch->sample_rate) / stretch->produced));
+    stretch->cost = 0;
+    stretch->produced = 0;
+  }
+}
+
+static GstBuffer* _audio_sink_stretch_buffer (GstBluetoothAudioSink *bluetoothaudiosink, GstBuffer *buffer)
+{
+  GstBluetoothAudioSinkStretch *stretch = &bluetoothaudiosink->stretch;
+  const gint64 start = g_get_monotonic_time ();
+  const guint bpf = (stretch->channels * sizeof (gint16));
+  GstBuffer *result = NULL;
+  GstMapInfo input;
+
+  if (GST_BUFFER_IS_DISCONT (buffer)) {
+    _audio_sink_stretch_flush (stretch);
+  }
+
+  if (!GST_CLOCK_TIME_IS_VALID (stretch->timestamp)) {
+    stretch->timestamp = _audio_sink_stretch_time (stretch, GST_BUFFER_PTS (buffer));
+  }
+
+  if (!gst_buffer_map (buffer, &input, GST_MAP_READ)) {
+    GST_ERROR_OBJECT (bluetoothaudiosink, "Failed to map buffer for time-stretching");
+  } else {
+    const guint frames = (input.size / bpf);
+    GstMapInfo output;
+
+    result = gst_buffer_new_allocate (NULL, (_audio_sink_stretch_capacity (stretch, frames) * bpf), NULL);
+
+    if (!gst_buffer_map (result, &output, GST_MAP_WRITE)) {
+      GST_ERROR_OBJECT (bluetoothaudiosink, "Failed to map buffer for time-stretching");
+      gst_buffer_unref (result);
+      result = NULL;
+    } else {
+      const guint produced = _audio_sink_stretch_process (stretch, (const gint16 *) input.data, frames, (gint16 *) output.data);
+
+      gst_buffer_unmap (result, &output);
+
+      result = _audio_sink_stretch_output (stretch, result, produced);
+    }
+
+    gst_buffer_unmap (buffer, &input);
+
+    _audio_sink_stretch_account (bluetoothaudiosink, start);
+  }
+
+  return result;
+}
+
+static GstBufferList* _audio_sink_stretch_buffer_list (GstBluetoothAudioSink *bluetoothaudiosink, GstBufferList *list)
+{
+  const guint length = gst_buffer_list_length (list);
+  GstBufferList *result = gst_buffer_list_new_sized (length);
+  guint i;
+
+  for (i = 0; i < length; i++) {
+    GstBuffer *buffer = _audio_sink_stretch_buffer (bluetoothaudiosink, gst_buffer_list_get (list, i));
+
+    if (buffer != NULL) {
+      gst_buffer_list_add (result, buffer);
+    }
+  }
+
+  if (gst_buffer_list_length (result) == 0) {
+    gst_buffer_list_unref (result);
+    result = NULL;
+  }
+
+  return result;
+}
+
+/* Stretches whatever input is still queued, so that nothing is lost at EOS or a segment change. */
+static GstBuffer* _audio_sink_stretch_drain (GstBluetoothAudioSink *bluetoothaudiosink)
+{
+  GstBluetoothAudioSinkStretch *stretch = &bluetoothaudiosink->stretch;
+  const guint channels = stretch->channels;
+  const guint size = (stretch->search + stretch->stride + stretch->overlap);
+  const guint target = ((stretch->active)? (guint) (stretch->queued / stretch->rate) : 0);
+  GstBuffer *result = NULL;
+  GstMapInfo output;
+
+  if (target != 0) {
+    const gint64 start = g_get_monotonic_time ();
+
+    result = gst_buffer_new_allocate (NULL, ((target + stretch->stride) * channels * sizeof (gint16)), NULL);
+
+    if (!gst_buffer_map (result, &output, GST_MAP_WRITE)) {
+      GST_ERROR_OBJECT (bluetoothaudiosink, "Failed to map buffer for time-stretching");
+      gst_buffer_unref (result);
+      result = NULL;
+    } else {
+      gint16 *samples = (gint16 *) output.data;
+      guint produced = 0;
+
+      /* Pad the queue with silence until all of the real input has been played out. */
+      while (produced < target) {
+        memset ((stretch->queue + (stretch->queued * channels)), 0, ((size - stretch->queued) * channels * sizeof (gint16)));
+        stretch->queued = size;
+
+        produced += _audio_sink_stretch_iterate (stretch, (samples + (produced * channels)));
+
+        _audio_sink_stretch_advance (stretch);
+      }
+
+      gst_buffer_unmap (result, &output);
+
+      result = _audio_sink_stretch_output (stretch, result, target);
+    }
+
+    _audio_sink_stretch_account (bluetoothaudiosink, start);
+
+    GST_DEBUG_OBJECT (bluetoothaudiosink, "Drained %u frames from the time-stretcher", target);
+  }
+
+  _audio_sink_stretch_flush (stretch);
+
+  return result;
+}
+
+static void _audio_sink_stretch_push_drained (GstBluetoothAudioSink *bluetoothaudiosink, GstPad *pad)
+{
+  GstBuffer *buffer = _audio_sink_stretch_drain (bluetoothaudiosink);
+
+  if (buffer != NULL) {
+    /* Serialized events are probed with the stream lock held, so the chain function can be called directly;
+       this also keeps the buffer from going through the probe a second time. */
+    const GstFlowReturn flow = GST_PAD_CHAINFUNC (pad) (pad, GST_OBJECT_PARENT (pad), buffer);
+
+    if (flow < GST_FLOW_EOS) {
+      /* The event goes on regardless, but the stream cannot; say so rather than let the audio go missing silently. */
+      GST_ELEMENT_ERROR (bluetoothaudiosink, STREAM, FAILED, ("Failed to render drained audio."),
+                         ("Rendering drained audio returned %s (%d)", gst_flow_get_name (flow), flow));
+    } else if (flow != GST_FLOW_OK) {
+      /* Flushing or EOS already, so there is nothing left to play the queue out to. */
+      GST_DEBUG_OBJECT (bluetoothaudiosink, "Rendering drained audio returned %s", gst_flow_get_name (flow));
+    }
+  }
+}
+
+static GstPadProbeReturn _audio_sink_stretch_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  GstBluetoothAudioSink *bluetoothaudiosink = (GstBluetoothAudioSink*)user_data;
+  GstBluetoothAudioSinkStretch *stretch = &bluetoothaudiosink->stretch;
+  GstPadProbeReturn result = GST_PAD_PROBE_OK;
+
+  g_assert (bluetoothaudiosink != NULL);
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    if (stretch->active) {
+      GstBuffer *buffer = _audio_sink_stretch_buffer (bluetoothaudiosink, GST_PAD_PROBE_INFO_BUFFER (info));
+
+      if (buffer == NULL) {
+        /* Everything went into the queue. */
+        result = GST_PAD_PROBE_DROP;
+      } else {
+        gst_buffer_unref (GST_PAD_PROBE_INFO_BUFFER (info));
+        GST_PAD_PROBE_INFO_DATA (info) = buffer;
+      }
+    }
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    if (stretch->active) {
+      GstBufferList *list = _audio_sink_stretch_buffer_list (bluetoothaudiosink, GST_PAD_PROBE_INFO_BUFFER_LIST (info));
+
+      if (list == NULL) {
+        result = GST_PAD_PROBE_DROP;
+      } else {
+        gst_buffer_list_unref (GST_PAD_PROBE_INFO_BUFFER_LIST (info));
+        GST_PAD_PROBE_INFO_DATA (info) = list;
+      }
+    }
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_BOTH) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+    switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:
+      {
+        GstCaps *caps = NULL;
+        GstAudioInfo audio_info;
+
+        gst_event_parse_caps (event, &caps);
+
+        if (gst_audio_info_from_caps (&audio_info, caps)) {
+          /* Whatever is queued was stretched for the previous format. */
+          _audio_sink_stretch_push_drained (bluetoothaudiosink, pad);
+          _audio_sink_stretch_configure (stretch, GST_AUDIO_INFO_RATE (&audio_info), GST_AUDIO_INFO_CHANNELS (&audio_info));
+        }
+      }
+      break;
+    case GST_EVENT_SEGMENT:
+      /* After a flush the queue is empty already; otherwise (e.g. gapless track changes) play out the rest first. */
+      _audio_sink_stretch_push_drained (bluetoothaudiosink, pad);
+      GST_PAD_PROBE_INFO_DATA (info) = _audio_sink_stretch_segment (bluetoothaudiosink, event);
+      break;
+    case GST_EVENT_EOS:
+      _audio_sink_stretch_push_drained (bluetoothaudiosink, pad);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      _audio_sink_stretch_flush (stretch);
+      break;
+    default:
+      break;
+    }
+  }
+
+  return result;
+}
+
 static void _audio_sink_initialize (GstBluetoothAudioSink *bluetoothaudiosink)
 {
   g_mutex_init (&bluetoothaudiosink->lock);
 
   _audio_sink_clear (bluetoothaudiosink);
+  _audio_sink_statistics_reset (bluetoothaudiosink);
+
+  bluetoothaudiosink->level.enabled = FALSE;
+  bluetoothaudiosink->level.interval = LEVEL_INTERVAL_DEFAULT;
+
+  _audio_sink_level_reset (&bluetoothaudiosink->level, bluetoothaudiosink->channels);
+
+  /* Trick-play rates are handled before the data reaches the ring buffer. */
+  gst_pad_add_probe (GST_BASE_SINK_PAD (bluetoothaudiosink),
+                     (GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+                     &_audio_sink_stretch_probe, bluetoothaudiosink, NULL);
 
   if (bluetoothaudiosink_init() != 0) {
     GST_ERROR_OBJECT (bluetoothaudiosink, "bluetoothaudiosink_init() failed");
@@ -403,6 +1483,8 @@ static void _audio_sink_dispose (GstBluetoothAudioSink *bluetoothaudiosink)
   bluetoothaudiosink_unregister_state_changed_callback (&_audio_sink_callback_state_changed);
   bluetoothaudiosink_unregister_operational_state_update_callback (&_audio_sink_callback_operational_state_updated);
   bluetoothaudiosink_deinit();
+
+  _audio_sink_stretch_free (&bluetoothaudiosink->stretch);
 }
 
 
@@ -423,7 +1505,14 @@ static void gst_bluetoothaudiosink_reset (GstAudioSink *sink);
 
 enum
 {
-  PROP_0
+  PROP_0,
+  PROP_LEVEL,
+  PROP_LEVEL_INTERVAL,
+  PROP_CALIBRATE_LATENCY,
+  PROP_LATENCY_OFFSET,
+  PROP_WRITE_ERRORS,
+  PROP_DISCARDED_BYTES,
+  PROP_RESUME_TIME
 };
 
 /* pad templates */
@@ -460,6 +1549,42 @@ static void gst_bluetoothaudiosink_class_init (GstBluetoothAudioSinkClass *klass
   gobject_class->dispose = gst_bluetoothaudiosink_dispose;
   gobject_class->finalize = gst_bluetoothaudiosink_finalize;
 
+  g_object_class_install_property (gobject_class, PROP_LEVEL,
+      g_param_spec_boolean ("level", "Level",
+          "Post \"level\" element messages with the RMS and peak of the audio as it is heard",
+          FALSE, (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_LEVEL_INTERVAL,
+      g_param_spec_uint64 ("level-interval", "Level interval",
+          "Interval of time between \"level\" messages (in nanoseconds)",
+          1, G_MAXUINT64, LEVEL_INTERVAL_DEFAULT, (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_CALIBRATE_LATENCY,
+      g_param_spec_boolean ("calibrate-latency", "Calibrate latency",
+          "Time frames from hand-over until the service reports them as played and adjust latency-offset accordingly "
+          "(errors in the playback position reported by the service itself go unnoticed)",
+          FALSE, (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_LATENCY_OFFSET,
+      g_param_spec_int64 ("latency-offset", "Latency offset",
+          "Correction applied to the delay reported for the device, which the sink clock follows gradually (in nanoseconds)",
+          -LATENCY_OFFSET_MAX, LATENCY_OFFSET_MAX, 0, (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_WRITE_ERRORS,
+      g_param_spec_uint ("write-errors", "Write errors",
+          "Number of frames the service failed to take since the sink was last prepared",
+          0, G_MAXUINT, 0, (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_DISCARDED_BYTES,
+      g_param_spec_uint64 ("discarded-bytes", "Discarded bytes",
+          "Bytes dropped to unblock writing on a reset since the sink was last prepared",
+          0, G_MAXUINT64, 0, (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_RESUME_TIME,
+      g_param_spec_uint64 ("resume-time", "Resume time",
+          "Time it took from the device reconnecting to playback resuming, for the last disconnection since the sink was last prepared (in nanoseconds)",
+          0, G_MAXUINT64, GST_CLOCK_TIME_NONE, (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
   audio_sink_class->open = GST_DEBUG_FUNCPTR (gst_bluetoothaudiosink_open);
   audio_sink_class->prepare = GST_DEBUG_FUNCPTR (gst_bluetoothaudiosink_prepare);
   audio_sink_class->unprepare = GST_DEBUG_FUNCPTR (gst_bluetoothaudiosink_unprepare);
@@ -485,6 +1610,31 @@ void gst_bluetoothaudiosink_set_property (GObject *object, guint property_id, co
   GST_DEBUG_OBJECT (bluetoothaudiosink, "set_property");
 
   switch (property_id) {
+    case PROP_LEVEL:
+      g_mutex_lock (&bluetoothaudiosink->lock);
+      bluetoothaudiosink->level.enabled = g_value_get_boolean (value);
+      g_mutex_unlock (&bluetoothaudiosink->lock);
+      break;
+    case PROP_LEVEL_INTERVAL:
+      g_mutex_lock (&bluetoothaudiosink->lock);
+      bluetoothaudiosink->level.interval = g_value_get_uint64 (value);
+      g_mutex_unlock (&bluetoothaudiosink->lock);
+      break;
+    case PROP_CALIBRATE_LATENCY:
+      g_mutex_lock (&bluetoothaudiosink->lock);
+      bluetoothaudiosink->latency.calibrate = g_value_get_boolean (value);
+      bluetoothaudiosink->latency.error = 0;
+      bluetoothaudiosink->latency.measurements = 0;
+      g_mutex_unlock (&bluetoothaudiosink->lock);
+      break;
+    case PROP_LATENCY_OFFSET:
+      g_mutex_lock (&bluetoothaudiosink->lock);
+      bluetoothaudiosink->latency.offset = g_value_get_int64 (value);
+      if (!bluetoothaudiosink->playing) {
+        bluetoothaudiosink->latency.applied = bluetoothaudiosink->latency.offset;
+      }
+      g_mutex_unlock (&bluetoothaudiosink->lock);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -498,6 +1648,39 @@ void gst_bluetoothaudiosink_get_property (GObject *object, guint property_id, GV
   GST_DEBUG_OBJECT (bluetoothaudiosink, "get_property");
 
   switch (property_id) {
+    case PROP_LEVEL:
+      g_mutex_lock (&bluetoothaudiosink->lock);
+      g_value_set_boolean (value, bluetoothaudiosink->level.enabled);
+      g_mutex_unlock (&bluetoothaudiosink->lock);
+      break;
+    case PROP_LEVEL_INTERVAL:
+      g_mutex_lock (&bluetoothaudiosink->lock);
+      g_value_set_uint64 (value, bluetoothaudiosink->level.interval);
+      g_mutex_unlock (&bluetoothaudiosink->lock);
+      break;
+    case PROP_CALIBRATE_LATENCY:
+      g_mutex_lock (&bluetoothaudiosink->lock);
+      g_value_set_boolean (value, bluetoothaudiosink->latency.calibrate);
+      g_mutex_unlock (&bluetoothaudiosink->lock);
+      break;
+    case PROP_LATENCY_OFFSET:
+      g_mutex_lock (&bluetoothaudiosink->lock);
+      g_value_set_int64 (value, bluetoothaudiosink->latency.offset);
+      g_mutex_unlock (&bluetoothaudiosink->lock);
+      break;
+    case PROP_WRITE_ERRORS:
+      g_value_set_uint (value, (guint) g_atomic_int_get (&bluetoothaudiosink->write_errors));
+      break;
+    case PROP_DISCARDED_BYTES:
+      g_mutex_lock (&bluetoothaudiosink->lock);
+      g_value_set_uint64 (value, bluetoothaudiosink->discarded_bytes);
+      g_mutex_unlock (&bluetoothaudiosink->lock);
+      break;
+    case PROP_RESUME_TIME:
+      g_mutex_lock (&bluetoothaudiosink->lock);
+      g_value_set_uint64 (value, bluetoothaudiosink->resume_time);
+      g_mutex_unlock (&bluetoothaudiosink->lock);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -563,6 +1746,8 @@ static gboolean gst_bluetoothaudiosink_prepare (GstAudioSink *sink, GstAudioRing
   GST_INFO_OBJECT (bluetoothaudiosink, "rate=%iHz, channels=%i, bpf=%i, bps=%i, framerate=%i.%02ifps, segsize=%i, segtotal=%i, latencytime=%ius",
                    sample_rate, (bpf/bps), bpf, bps, (frame_rate/100), (frame_rate%100), spec->segsize, spec->segtotal, spec->latency_time);
 
+  _audio_sink_statistics_reset (bluetoothaudiosink);
+
   if (!_audio_sink_acquire (bluetoothaudiosink, TRUE, sample_rate, frame_rate, bpf, bps)) {
     GST_ERROR_OBJECT (bluetoothaudiosink, "Failed to acquire Bluetooth audio sink device!");
     result = FALSE;
@@ -617,8 +1802,17 @@ static gint gst_bluetoothaudiosink_write (GstAudioSink *sink, gpointer data, gui
 
   // GST_DEBUG_OBJECT (bluetoothaudiosink, "write");
 
+  const gboolean marked = _audio_sink_latency_mark (bluetoothaudiosink);
+
   const gint result = _audio_sink_frame (bluetoothaudiosink, data, length);
 
+  /* Meter what was actually handed over, while it is still in cache. */
+  if (result > 0) {
+    _audio_sink_level (bluetoothaudiosink, data, result);
+  }
+
+  _audio_sink_latency_update (bluetoothaudiosink, marked, result);
+
   return result;
 }
 
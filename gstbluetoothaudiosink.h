@@ -32,6 +32,83 @@ G_BEGIN_DECLS
 
 typedef struct _GstBluetoothAudioSink GstBluetoothAudioSink;
 typedef struct _GstBluetoothAudioSinkClass GstBluetoothAudioSinkClass;
+typedef struct _GstBluetoothAudioSinkStretch GstBluetoothAudioSinkStretch;
+typedef struct _GstBluetoothAudioSinkLevel GstBluetoothAudioSinkLevel;
+typedef struct _GstBluetoothAudioSinkLatency GstBluetoothAudioSinkLatency;
+
+#define GST_BLUETOOTHAUDIOSINK_MAX_CHANNELS (2)
+#define GST_BLUETOOTHAUDIOSINK_LEVEL_LANES (8) /* must be a multiple of every channel count */
+
+/* Pitch-preserving time-stretcher (WSOLA) used for trick-play rates. */
+struct _GstBluetoothAudioSinkStretch
+{
+  gboolean active;
+  gdouble rate;
+  GstSegment segment; /* segment as received from upstream */
+
+  guint sample_rate;
+  guint channels;
+
+  guint stride; /* output frames per iteration */
+  guint overlap; /* crossfaded frames per iteration */
+  guint search; /* candidate offsets examined per iteration */
+  gdouble hop_error; /* fractional input frames carried over */
+
+  gint16 *queue; /* (search + stride + overlap) frames of input */
+  guint queued;
+  guint skip; /* input frames still to be dropped */
+  gint16 *tail; /* overlap frames following the last output */
+  gint16 *window; /* windowed copy of the tail used for the search */
+  gint32 *blend; /* Q15 crossfade weights, per sample */
+  gint32 *shape; /* Q15 correlation window, per sample */
+  gboolean primed;
+  gboolean discont;
+
+  GstClockTime timestamp; /* of the first output frame since the last flush */
+  guint64 offset; /* output frames since the last flush */
+
+  guint64 cost; /* microseconds spent stretching */
+  guint64 produced; /* output frames since cost was last reported */
+};
+
+/* RMS/peak meter fed from the write path. */
+struct _GstBluetoothAudioSinkLevel
+{
+  gboolean enabled;
+  GstClockTime interval;
+
+  guint channels;
+  guint64 frames; /* metered in the current interval */
+  gint64 sum[GST_BLUETOOTHAUDIOSINK_LEVEL_LANES]; /* sums of squares, per lane */
+  gint32 peak[GST_BLUETOOTHAUDIOSINK_LEVEL_LANES]; /* absolute peaks, per lane */
+
+  gint16 partial[GST_BLUETOOTHAUDIOSINK_MAX_CHANNELS]; /* frame split across two writes */
+  guint partial_size; /* bytes of it received so far */
+
+  gdouble decay[GST_BLUETOOTHAUDIOSINK_MAX_CHANNELS]; /* decaying peak, in dB */
+  gdouble decay_base[GST_BLUETOOTHAUDIOSINK_MAX_CHANNELS]; /* peak the decay started from, in dB */
+  GstClockTime decay_age[GST_BLUETOOTHAUDIOSINK_MAX_CHANNELS];
+};
+
+/* End-to-end latency calibration against the playback position reported by the service. */
+struct _GstBluetoothAudioSinkLatency
+{
+  gboolean calibrate;
+  gint64 offset; /* nanoseconds to add to the delay reported by the service */
+  gint64 applied; /* nanoseconds currently added, slewing towards offset */
+  gint64 slewed; /* monotonic time applied was last updated */
+
+  guint64 submitted; /* bytes handed over since playback started */
+  gboolean pending; /* a marked frame is on its way to the device */
+  guint64 marker; /* position of the marked frame */
+  gint64 marked; /* monotonic time the pending marker was handed over */
+  gint64 polled; /* monotonic time the playback position was last queried */
+  GstClockTime expected; /* latency of the pending marker according to the reported delay and target offset */
+  gint64 next; /* monotonic time at which the next frame may be marked */
+
+  gint64 error; /* sum of the measured errors in the current batch */
+  guint measurements;
+};
 
 struct _GstBluetoothAudioSink
 {
@@ -51,6 +128,18 @@ struct _GstBluetoothAudioSink
   gboolean acquired;
   gboolean playing;
 
+  // private:
+  gboolean interrupted; /* playback was interrupted by a disconnection */
+  gint64 reconnected; /* monotonic time the device reconnected after that, if it did */
+  GstClockTime resume_time; /* it took to get back to playing after the last reconnection */
+  gint write_errors; /* updated atomically */
+  guint64 discarded_bytes; /* reported as written on a reset, but never handed over */
+
+  // private:
+  GstBluetoothAudioSinkStretch stretch;
+  GstBluetoothAudioSinkLevel level;
+  GstBluetoothAudioSinkLatency latency;
+
   GMutex lock;
 };
 
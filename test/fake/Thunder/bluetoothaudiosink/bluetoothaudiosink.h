@@ -0,0 +1,74 @@
+/* GStreamer
+ * Copyright (C) 2021 Metrological
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/* Stand-in for the Thunder BluetoothAudioSink client library header, declaring
+   just what the sink uses. Implemented by fakebluetoothaudiosink.c. */
+
+#ifndef _FAKE_BLUETOOTHAUDIOSINK_CLIENT_H_
+#define _FAKE_BLUETOOTHAUDIOSINK_CLIENT_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum bluetoothaudiosink_state_type {
+  BLUETOOTHAUDIOSINK_STATE_UNASSIGNED,
+  BLUETOOTHAUDIOSINK_STATE_CONNECTING,
+  BLUETOOTHAUDIOSINK_STATE_CONNECTED,
+  BLUETOOTHAUDIOSINK_STATE_CONNECTED_BAD,
+  BLUETOOTHAUDIOSINK_STATE_CONNECTED_RESTRICTED,
+  BLUETOOTHAUDIOSINK_STATE_DISCONNECTED,
+  BLUETOOTHAUDIOSINK_STATE_READY,
+  BLUETOOTHAUDIOSINK_STATE_STREAMING
+} bluetoothaudiosink_state_t;
+
+typedef struct bluetoothaudiosink_format_type {
+  uint32_t sample_rate;
+  uint16_t frame_rate; /* in hundredths of Hz */
+  uint8_t channels;
+  uint8_t resolution; /* in bits */
+} bluetoothaudiosink_format_t;
+
+typedef void (*bluetoothaudiosink_state_changed_cb) (const bluetoothaudiosink_state_t state, void *user_data);
+typedef void (*bluetoothaudiosink_operational_state_update_cb) (const uint8_t running, void *user_data);
+
+uint32_t bluetoothaudiosink_init (void);
+uint32_t bluetoothaudiosink_deinit (void);
+
+uint32_t bluetoothaudiosink_register_state_changed_callback (const bluetoothaudiosink_state_changed_cb callback, const void *user_data);
+uint32_t bluetoothaudiosink_unregister_state_changed_callback (const bluetoothaudiosink_state_changed_cb callback);
+uint32_t bluetoothaudiosink_register_operational_state_update_callback (const bluetoothaudiosink_operational_state_update_cb callback, const void *user_data);
+uint32_t bluetoothaudiosink_unregister_operational_state_update_callback (const bluetoothaudiosink_operational_state_update_cb callback);
+
+uint32_t bluetoothaudiosink_state (bluetoothaudiosink_state_t *state);
+uint32_t bluetoothaudiosink_configure (const bluetoothaudiosink_format_t *format);
+uint32_t bluetoothaudiosink_acquire (void);
+uint32_t bluetoothaudiosink_relinquish (void);
+uint32_t bluetoothaudiosink_speed (const int8_t speed);
+uint32_t bluetoothaudiosink_time (uint32_t *timems);
+uint32_t bluetoothaudiosink_delay (uint32_t *delay_samples);
+uint32_t bluetoothaudiosink_frame (const uint16_t length, const uint8_t data[], uint16_t *consumed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _FAKE_BLUETOOTHAUDIOSINK_CLIENT_H_
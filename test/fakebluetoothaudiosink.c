@@ -0,0 +1,606 @@
+/* GStreamer
+ * Copyright (C) 2021 Metrological
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#include <string.h>
+
+#include "fakebluetoothaudiosink.h"
+
+/* Fake Thunder BluetoothAudioSink client library.
+
+   Like the real service, it acts on connections and speed changes asynchronously and notifies state changes
+   from its own thread. The device plays frames in real time out of a buffer of FAKE_BUFFER_TIME, so that
+   bluetoothaudiosink_frame() blocks the way it does with a real device. */
+
+typedef struct _FakeEvent FakeEvent;
+
+struct _FakeEvent
+{
+  gint64 due; /* monotonic time */
+  guint epoch;
+  gboolean quit;
+  gboolean transition; /* enter the state before notifying it */
+  gboolean operational; /* notify the service availability instead */
+  bluetoothaudiosink_state_t state;
+  gboolean running;
+};
+
+static struct
+{
+  GMutex lock;
+  GAsyncQueue *events;
+  GThread *dispatcher;
+
+  bluetoothaudiosink_state_changed_cb state_callback;
+  void *state_user_data;
+  bluetoothaudiosink_operational_state_update_cb operational_callback;
+  void *operational_user_data;
+
+  bluetoothaudiosink_state_t state;
+  guint epoch; /* bumped when the device disconnects or is relinquished, cancelling transitions in flight */
+  gboolean connecting;
+  gboolean acquired;
+  guint lag;
+  guint latency;
+
+  guint sample_rate;
+  guint channels;
+  guint bpf;
+
+  guint64 queued; /* frames buffered in the device */
+  gint64 updated; /* monotonic time the buffer was last drained */
+  guint64 played; /* frames drained since streaming started */
+
+  gint64 reconnected; /* monotonic time of the last reconnection, until frames are taken again */
+  FakeBluetoothAudioSinkStatistics statistics;
+} fake;
+
+static void _fake_schedule (const gboolean transition, const bluetoothaudiosink_state_t state)
+{
+  FakeEvent *event = g_new0 (FakeEvent, 1);
+
+  /* (Lock held.) */
+  event->due = (g_get_monotonic_time () + (fake.lag * 1000));
+  event->epoch = fake.epoch;
+  event->transition = transition;
+  event->state = state;
+
+  g_async_queue_push (fake.events, event);
+}
+
+static void _fake_drain (const gint64 now)
+{
+  /* (Lock held.) */
+  const guint64 frames = (((now - fake.updated) * fake.sample_rate) / G_USEC_PER_SEC);
+
+  if (frames >= fake.queued) {
+    /* Underrun; the device does not catch up on the time lost. */
+    fake.played += fake.queued;
+    fake.queued = 0;
+    fake.updated = now;
+  } else {
+    fake.played += frames;
+    fake.queued -= frames;
+    fake.updated += ((frames * G_USEC_PER_SEC) / fake.sample_rate);
+  }
+}
+
+static void _fake_enter (const bluetoothaudiosink_state_t state)
+{
+  /* (Lock held.) */
+  if ((state == BLUETOOTHAUDIOSINK_STATE_STREAMING) && (fake.state != BLUETOOTHAUDIOSINK_STATE_STREAMING)) {
+    /* Playback position starts over. */
+    fake.played = 0;
+    fake.updated = g_get_monotonic_time ();
+  }
+
+  if ((state == BLUETOOTHAUDIOSINK_STATE_CONNECTED) && (fake.state == BLUETOOTHAUDIOSINK_STATE_DISCONNECTED)) {
+    fake.connecting = FALSE;
+    fake.reconnected = g_get_monotonic_time ();
+  }
+
+  if (state != BLUETOOTHAUDIOSINK_STATE_STREAMING) {
+    fake.queued = 0;
+  }
+
+  fake.state = state;
+}
+
+static void _fake_count (void)
+{
+  g_mutex_lock (&fake.lock);
+
+  fake.statistics.callbacks++;
+
+  g_mutex_unlock (&fake.lock);
+}
+
+static void _fake_notify (const FakeEvent *event, bluetoothaudiosink_state_changed_cb state_callback, void *state_user_data,
+                          bluetoothaudiosink_operational_state_update_cb operational_callback, void *operational_user_data)
+{
+  if (event->operational) {
+    if (operational_callback != NULL) {
+      _fake_count ();
+      operational_callback (event->running, operational_user_data);
+    }
+  } else {
+    if (state_callback != NULL) {
+      _fake_count ();
+      state_callback (event->state, state_user_data);
+    }
+  }
+}
+
+static gpointer _fake_dispatch (gpointer data)
+{
+  gboolean quit = FALSE;
+
+  while (!quit) {
+    FakeEvent *event = (FakeEvent *) g_async_queue_pop (fake.events);
+
+    quit = event->quit;
+
+    if (!quit) {
+      const gint64 wait = (event->due - g_get_monotonic_time ());
+      gboolean notify = TRUE;
+
+      if (wait > 0) {
+        g_usleep (wait);
+      }
+
+      g_mutex_lock (&fake.lock);
+
+      if (event->transition) {
+        if (event->epoch != fake.epoch) {
+          /* Overtaken by a disconnection or relinquish. */
+          notify = FALSE;
+        } else {
+          _fake_enter (event->state);
+        }
+      }
+
+      bluetoothaudiosink_state_changed_cb state_callback = fake.state_callback;
+      void *state_user_data = fake.state_user_data;
+      bluetoothaudiosink_operational_state_update_cb operational_callback = fake.operational_callback;
+      void *operational_user_data = fake.operational_user_data;
+
+      g_mutex_unlock (&fake.lock);
+
+      if (notify) {
+        _fake_notify (event, state_callback, state_user_data, operational_callback, operational_user_data);
+      }
+    }
+
+    g_free (event);
+  }
+
+  return NULL;
+}
+
+/* client library */
+
+uint32_t bluetoothaudiosink_init (void)
+{
+  g_mutex_lock (&fake.lock);
+
+  if (fake.events == NULL) {
+    fake.events = g_async_queue_new ();
+    fake.dispatcher = g_thread_new ("fake-dispatcher", &_fake_dispatch, NULL);
+    fake.state = BLUETOOTHAUDIOSINK_STATE_DISCONNECTED;
+  }
+
+  g_mutex_unlock (&fake.lock);
+
+  return 0;
+}
+
+uint32_t bluetoothaudiosink_deinit (void)
+{
+  FakeEvent *event = g_new0 (FakeEvent, 1);
+  GThread *dispatcher = NULL;
+
+  g_mutex_lock (&fake.lock);
+
+  event->quit = TRUE;
+  g_async_queue_push (fake.events, event);
+
+  dispatcher = fake.dispatcher;
+  fake.dispatcher = NULL;
+
+  g_mutex_unlock (&fake.lock);
+
+  g_thread_join (dispatcher);
+
+  g_mutex_lock (&fake.lock);
+
+  g_async_queue_unref (fake.events);
+  fake.events = NULL;
+
+  g_mutex_unlock (&fake.lock);
+
+  return 0;
+}
+
+uint32_t bluetoothaudiosink_register_state_changed_callback (const bluetoothaudiosink_state_changed_cb callback, const void *user_data)
+{
+  g_mutex_lock (&fake.lock);
+
+  fake.state_callback = callback;
+  fake.state_user_data = (void *) user_data;
+
+  g_mutex_unlock (&fake.lock);
+
+  return 0;
+}
+
+uint32_t bluetoothaudiosink_unregister_state_changed_callback (const bluetoothaudiosink_state_changed_cb callback)
+{
+  g_mutex_lock (&fake.lock);
+
+  if (fake.state_callback == callback) {
+    fake.state_callback = NULL;
+    fake.state_user_data = NULL;
+  }
+
+  g_mutex_unlock (&fake.lock);
+
+  return 0;
+}
+
+uint32_t bluetoothaudiosink_register_operational_state_update_callback (const bluetoothaudiosink_operational_state_update_cb callback, const void *user_data)
+{
+  FakeEvent *event = g_new0 (FakeEvent, 1);
+
+  g_mutex_lock (&fake.lock);
+
+  fake.operational_callback = callback;
+  fake.operational_user_data = (void *) user_data;
+
+  /* The service is up already. */
+  event->operational = TRUE;
+  event->running = TRUE;
+  g_async_queue_push (fake.events, event);
+
+  g_mutex_unlock (&fake.lock);
+
+  return 0;
+}
+
+uint32_t bluetoothaudiosink_unregister_operational_state_update_callback (const bluetoothaudiosink_operational_state_update_cb callback)
+{
+  g_mutex_lock (&fake.lock);
+
+  if (fake.operational_callback == callback) {
+    fake.operational_callback = NULL;
+    fake.operational_user_data = NULL;
+  }
+
+  g_mutex_unlock (&fake.lock);
+
+  return 0;
+}
+
+uint32_t bluetoothaudiosink_state (bluetoothaudiosink_state_t *state)
+{
+  g_mutex_lock (&fake.lock);
+
+  *state = fake.state;
+
+  g_mutex_unlock (&fake.lock);
+
+  return 0;
+}
+
+uint32_t bluetoothaudiosink_configure (const bluetoothaudiosink_format_t *format)
+{
+  uint32_t result = 1;
+
+  g_mutex_lock (&fake.lock);
+
+  if ((fake.state == BLUETOOTHAUDIOSINK_STATE_CONNECTED) && (format->sample_rate != 0) && (format->channels != 0) && (format->resolution == 16)) {
+    fake.sample_rate = format->sample_rate;
+    fake.channels = format->channels;
+    fake.bpf = (format->channels * (format->resolution / 8));
+    result = 0;
+  }
+
+  g_mutex_unlock (&fake.lock);
+
+  return result;
+}
+
+uint32_t bluetoothaudiosink_acquire (void)
+{
+  uint32_t result = 1;
+
+  g_mutex_lock (&fake.lock);
+
+  if ((fake.state == BLUETOOTHAUDIOSINK_STATE_CONNECTED) && (fake.bpf != 0)) {
+    fake.acquired = TRUE;
+    _fake_enter (BLUETOOTHAUDIOSINK_STATE_READY);
+    _fake_schedule (FALSE, BLUETOOTHAUDIOSINK_STATE_READY);
+    result = 0;
+  }
+
+  g_mutex_unlock (&fake.lock);
+
+  return result;
+}
+
+uint32_t bluetoothaudiosink_relinquish (void)
+{
+  uint32_t result = 1;
+
+  g_mutex_lock (&fake.lock);
+
+  if (fake.acquired) {
+    fake.acquired = FALSE;
+    fake.epoch++;
+    _fake_enter (BLUETOOTHAUDIOSINK_STATE_CONNECTED);
+    _fake_schedule (FALSE, BLUETOOTHAUDIOSINK_STATE_CONNECTED);
+    result = 0;
+  }
+
+  g_mutex_unlock (&fake.lock);
+
+  return result;
+}
+
+uint32_t bluetoothaudiosink_speed (const int8_t speed)
+{
+  uint32_t result = 1;
+
+  g_mutex_lock (&fake.lock);
+
+  if ((fake.acquired) && ((fake.state == BLUETOOTHAUDIOSINK_STATE_READY) || (fake.state == BLUETOOTHAUDIOSINK_STATE_STREAMING))) {
+    _fake_schedule (TRUE, ((speed != 0)? BLUETOOTHAUDIOSINK_STATE_STREAMING : BLUETOOTHAUDIOSINK_STATE_READY));
+    result = 0;
+  }
+
+  g_mutex_unlock (&fake.lock);
+
+  return result;
+}
+
+uint32_t bluetoothaudiosink_time (uint32_t *timems)
+{
+  uint32_t result = 1;
+
+  g_mutex_lock (&fake.lock);
+
+  if (fake.state == BLUETOOTHAUDIOSINK_STATE_STREAMING) {
+    const guint64 latency = ((fake.latency * fake.sample_rate) / 1000);
+
+    _fake_drain (g_get_monotonic_time ());
+
+    *timems = (uint32_t) ((((fake.played > latency)? (fake.played - latency) : 0) * 1000) / fake.sample_rate);
+    result = 0;
+  }
+
+  g_mutex_unlock (&fake.lock);
+
+  return result;
+}
+
+uint32_t bluetoothaudiosink_delay (uint32_t *delay_samples)
+{
+  g_mutex_lock (&fake.lock);
+
+  *delay_samples = 0;
+
+  if (fake.state == BLUETOOTHAUDIOSINK_STATE_STREAMING) {
+    _fake_drain (g_get_monotonic_time ());
+
+    /* Reported in samples, as the real service does. */
+    *delay_samples = (uint32_t) (fake.queued * fake.channels);
+  }
+
+  g_mutex_unlock (&fake.lock);
+
+  return 0;
+}
+
+uint32_t bluetoothaudiosink_frame (const uint16_t length, const uint8_t data[], uint16_t *consumed)
+{
+  uint32_t result = 1;
+  gboolean done = FALSE;
+
+  *consumed = 0;
+
+  while (!done) {
+    g_mutex_lock (&fake.lock);
+
+    if ((fake.state != BLUETOOTHAUDIOSINK_STATE_STREAMING) || ((length % fake.bpf) != 0)) {
+      fake.statistics.rejected++;
+      done = TRUE;
+    } else {
+      const gint64 now = g_get_monotonic_time ();
+      const guint64 capacity = ((fake.sample_rate * FAKE_BUFFER_TIME) / 1000);
+      const guint64 frames = (length / fake.bpf);
+
+      _fake_drain (now);
+
+      if ((fake.queued + frames) <= capacity) {
+        fake.queued += frames;
+        fake.statistics.received += length;
+
+        if (fake.reconnected != 0) {
+          const gint64 resume = (now - fake.reconnected);
+
+          fake.statistics.resumes++;
+          fake.statistics.resume_total += resume;
+          fake.statistics.resume_max = MAX (fake.statistics.resume_max, resume);
+          fake.reconnected = 0;
+        }
+
+        *consumed = length;
+        result = 0;
+        done = TRUE;
+      } else {
+        const gint64 wait = ((((fake.queued + frames) - capacity) * G_USEC_PER_SEC) / fake.sample_rate);
+
+        g_mutex_unlock (&fake.lock);
+
+        /* Blocks, like with a real device. */
+        g_usleep (wait);
+
+        g_mutex_lock (&fake.lock);
+      }
+    }
+
+    g_mutex_unlock (&fake.lock);
+  }
+
+  return result;
+}
+
+/* controls */
+
+void fake_bluetoothaudiosink_set_lag (guint lag)
+{
+  g_mutex_lock (&fake.lock);
+
+  fake.lag = lag;
+
+  g_mutex_unlock (&fake.lock);
+}
+
+void fake_bluetoothaudiosink_set_latency (guint latency)
+{
+  g_mutex_lock (&fake.lock);
+
+  fake.latency = latency;
+
+  g_mutex_unlock (&fake.lock);
+}
+
+void fake_bluetoothaudiosink_connect (void)
+{
+  g_mutex_lock (&fake.lock);
+
+  if ((fake.state == BLUETOOTHAUDIOSINK_STATE_DISCONNECTED) && (!fake.connecting)) {
+    fake.connecting = TRUE;
+    _fake_schedule (TRUE, BLUETOOTHAUDIOSINK_STATE_CONNECTED);
+  }
+
+  g_mutex_unlock (&fake.lock);
+}
+
+void fake_bluetoothaudiosink_disconnect (void)
+{
+  FakeEvent event;
+
+  memset (&event, 0, sizeof (event));
+
+  g_mutex_lock (&fake.lock);
+
+  const gboolean disconnect = (fake.state != BLUETOOTHAUDIOSINK_STATE_DISCONNECTED);
+
+  if (disconnect) {
+    fake.statistics.disconnections++;
+    fake.acquired = FALSE;
+    fake.epoch++;
+    _fake_enter (BLUETOOTHAUDIOSINK_STATE_DISCONNECTED);
+  }
+
+  fake.connecting = FALSE;
+  fake.reconnected = 0;
+
+  event.state = BLUETOOTHAUDIOSINK_STATE_DISCONNECTED;
+  bluetoothaudiosink_state_changed_cb state_callback = fake.state_callback;
+  void *state_user_data = fake.state_user_data;
+
+  g_mutex_unlock (&fake.lock);
+
+  if (disconnect) {
+    _fake_notify (&event, state_callback, state_user_data, NULL, NULL);
+  }
+}
+
+void fake_bluetoothaudiosink_spurious (void)
+{
+  FakeEvent event;
+
+  memset (&event, 0, sizeof (event));
+
+  g_mutex_lock (&fake.lock);
+
+  event.state = fake.state;
+
+  if ((event.state == BLUETOOTHAUDIOSINK_STATE_STREAMING) && (g_random_boolean ())) {
+    /* A late notification of the previous state. */
+    event.state = BLUETOOTHAUDIOSINK_STATE_READY;
+  }
+
+  bluetoothaudiosink_state_changed_cb state_callback = fake.state_callback;
+  void *state_user_data = fake.state_user_data;
+
+  g_mutex_unlock (&fake.lock);
+
+  _fake_notify (&event, state_callback, state_user_data, NULL, NULL);
+}
+
+void fake_bluetoothaudiosink_restart (void)
+{
+  FakeEvent event;
+
+  memset (&event, 0, sizeof (event));
+
+  g_mutex_lock (&fake.lock);
+
+  event.operational = TRUE;
+  bluetoothaudiosink_operational_state_update_cb operational_callback = fake.operational_callback;
+  void *operational_user_data = fake.operational_user_data;
+
+  g_mutex_unlock (&fake.lock);
+
+  event.running = FALSE;
+  _fake_notify (&event, NULL, NULL, operational_callback, operational_user_data);
+
+  event.running = TRUE;
+  _fake_notify (&event, NULL, NULL, operational_callback, operational_user_data);
+}
+
+bluetoothaudiosink_state_t fake_bluetoothaudiosink_get_state (void)
+{
+  bluetoothaudiosink_state_t state;
+
+  bluetoothaudiosink_state (&state);
+
+  return state;
+}
+
+gboolean fake_bluetoothaudiosink_is_registered (void)
+{
+  g_mutex_lock (&fake.lock);
+
+  const gboolean result = (fake.state_callback != NULL);
+
+  g_mutex_unlock (&fake.lock);
+
+  return result;
+}
+
+void fake_bluetoothaudiosink_get_statistics (FakeBluetoothAudioSinkStatistics *statistics)
+{
+  g_mutex_lock (&fake.lock);
+
+  *statistics = fake.statistics;
+
+  g_mutex_unlock (&fake.lock);
+}
@@ -0,0 +1,68 @@
+/* GStreamer
+ * Copyright (C) 2021 Metrological
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#ifndef _FAKE_BLUETOOTHAUDIOSINK_H_
+#define _FAKE_BLUETOOTHAUDIOSINK_H_
+
+#include <glib.h>
+#include <Thunder/bluetoothaudiosink/bluetoothaudiosink.h>
+
+G_BEGIN_DECLS
+
+/* Controls of the fake client library, for the test to script the service and the device with. */
+
+#define FAKE_BUFFER_TIME (100) /* milliseconds of audio the device buffers */
+
+typedef struct _FakeBluetoothAudioSinkStatistics FakeBluetoothAudioSinkStatistics;
+
+struct _FakeBluetoothAudioSinkStatistics
+{
+  guint64 received; /* bytes taken by bluetoothaudiosink_frame() */
+  guint rejected; /* bluetoothaudiosink_frame() calls failed */
+  guint callbacks; /* state and operational callbacks delivered */
+
+  guint disconnections;
+  guint resumes; /* reconnections followed by frames being taken again */
+  gint64 resume_total; /* microseconds from reconnection to the first frame taken */
+  gint64 resume_max;
+};
+
+/* Time the service takes to act on connections and speed changes (in milliseconds). */
+void fake_bluetoothaudiosink_set_lag (guint lag);
+
+/* Latency of the device on top of the delay it reports (in milliseconds). */
+void fake_bluetoothaudiosink_set_latency (guint latency);
+
+/* The device connects after the lag; disconnecting is immediate and notified from the calling thread. */
+void fake_bluetoothaudiosink_connect (void);
+void fake_bluetoothaudiosink_disconnect (void);
+
+/* Notifies the current or a stale state from the calling thread, without changing it. */
+void fake_bluetoothaudiosink_spurious (void);
+
+/* Notifies the service going down and coming back up from the calling thread. */
+void fake_bluetoothaudiosink_restart (void);
+
+bluetoothaudiosink_state_t fake_bluetoothaudiosink_get_state (void);
+gboolean fake_bluetoothaudiosink_is_registered (void);
+void fake_bluetoothaudiosink_get_statistics (FakeBluetoothAudioSinkStatistics *statistics);
+
+G_END_DECLS
+
+#endif // _FAKE_BLUETOOTHAUDIOSINK_H_
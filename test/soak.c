@@ -0,0 +1,698 @@
+/* GStreamer
+ * Copyright (C) 2021 Metrological
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/* State machine soak test.
+
+   Streams into the sink from a writer thread, the way the audio ring buffer does, while the sink is
+   prepared and unprepared over and over and several threads storm it with disconnections, spurious state
+   notifications and service restarts, next to the fake service's own notification thread.
+
+   Reports how long the sink lock is held and waited for, writes acknowledged but never handed over to the
+   service, and how long it takes to get back to playing after a reconnection. A watchdog aborts the test if
+   the sink lock is held or any thread stalls for too long. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gst/gst.h>
+#include <gst/audio/gstaudiosink.h>
+#include "gstbluetoothaudiosink.h"
+
+#include "fakebluetoothaudiosink.h"
+
+#define SOAK_RATE (48000)
+#define SOAK_CHANNELS (2)
+#define SOAK_BPF (SOAK_CHANNELS * 2)
+#define SOAK_SEGMENT (SOAK_RATE / 100) /* frames written at a time, as in a 10 ms ring buffer segment */
+
+#define SOAK_DURATION (20) /* seconds of storm, unless given on the command line */
+#define SOAK_LAG (30) /* milliseconds the fake service takes to act */
+#define SOAK_STORM_THREADS (3)
+#define SOAK_QUICK_CYCLES (20)
+
+#define SOAK_HELD_MAX (2 * G_USEC_PER_SEC) /* sink lock held for longer is taken for a deadlock */
+#define SOAK_STALL_MAX (5 * G_USEC_PER_SEC) /* a thread not heard of for longer is taken for deadlocked */
+#define SOAK_RESUME_MAX (2 * G_USEC_PER_SEC) /* allowed to get back to playing where nothing stands in the way */
+
+#define SOAK_CALIBRATION_LATENCY (400) /* milliseconds hidden from the delay the device reports */
+#define SOAK_CALIBRATION_TOLERANCE (20 * (gint64) GST_MSECOND)
+#define SOAK_CALIBRATION_BATCH (5) /* measurements per offset update */
+#define SOAK_CALIBRATION_BATCHES (3) /* the first finds the latency, the others are taken while the clock still slews */
+#define SOAK_CALIBRATION_SLEW (SOAK_CALIBRATION_LATENCY * 20) /* milliseconds the clock takes to follow the first update */
+#define SOAK_CALIBRATION_TIME (75) /* seconds allowed for all batches of measurements */
+
+enum
+{
+  SOAK_BEAT_WRITER,
+  SOAK_BEAT_CONTROL,
+  SOAK_BEAT_STORM,
+  SOAK_BEATS = (SOAK_BEAT_STORM + SOAK_STORM_THREADS)
+};
+
+typedef struct _SoakStat SoakStat;
+
+struct _SoakStat
+{
+  guint64 count;
+  gint64 total;
+  gint64 max;
+};
+
+static struct
+{
+  GMutex lock; /* for this struct only, never held across calls into the sink */
+
+  GMutex *watched; /* the sink lock */
+  gint64 held; /* monotonic time the sink lock was taken, 0 when free */
+  SoakStat hold; /* microseconds */
+  SoakStat wait; /* microseconds */
+
+  gint64 beats[SOAK_BEATS]; /* monotonic time each thread was last heard of, 0 when not watched */
+} soak;
+
+static struct
+{
+  GMutex lock;
+  GCond cond;
+  gint run; /* (atomic) */
+  gboolean idle;
+  gboolean quit;
+
+  guint64 acked; /* bytes write() reported as written */
+} writer;
+
+static struct
+{
+  gint calm; /* (atomic) storm threads to stop */
+  gint quit; /* (atomic) watchdog to stop */
+
+  guint cycles;
+  guint prepare_failures;
+  guint unprepare_failures;
+
+  guint write_errors;
+  guint64 discarded;
+  SoakStat resume_time; /* microseconds, as reported by the sink */
+} control;
+
+static gint failures = 0;
+
+static const gchar *beat_names[SOAK_BEATS] = { "writer", "control", "storm 1", "storm 2", "storm 3" };
+
+static void _soak_stat_add (SoakStat *stat, const gint64 value)
+{
+  stat->count++;
+  stat->total += value;
+  stat->max = MAX (stat->max, value);
+}
+
+static gint64 _soak_stat_mean (const SoakStat *stat)
+{
+  return ((stat->count != 0)? (stat->total / (gint64) stat->count) : 0);
+}
+
+static void _soak_fail (const gchar *reason)
+{
+  g_printerr ("FAIL: %s\n", reason);
+  g_atomic_int_inc (&failures);
+}
+
+static void _soak_beat (const guint beat, const gboolean watch)
+{
+  g_mutex_lock (&soak.lock);
+
+  soak.beats[beat] = (watch? g_get_monotonic_time () : 0);
+
+  g_mutex_unlock (&soak.lock);
+}
+
+/* lock instrumentation (see soaksink.c) */
+
+void soak_mutex_lock (GMutex *mutex)
+{
+  const gint64 start = g_get_monotonic_time ();
+
+  g_mutex_lock (mutex);
+
+  if (mutex == g_atomic_pointer_get (&soak.watched)) {
+    const gint64 now = g_get_monotonic_time ();
+
+    g_mutex_lock (&soak.lock);
+
+    soak.held = now;
+    _soak_stat_add (&soak.wait, (now - start));
+
+    g_mutex_unlock (&soak.lock);
+  }
+}
+
+void soak_mutex_unlock (GMutex *mutex)
+{
+  if (mutex == g_atomic_pointer_get (&soak.watched)) {
+    const gint64 now = g_get_monotonic_time ();
+
+    g_mutex_lock (&soak.lock);
+
+    if (soak.held != 0) {
+      _soak_stat_add (&soak.hold, (now - soak.held));
+      soak.held = 0;
+    }
+
+    g_mutex_unlock (&soak.lock);
+  }
+
+  g_mutex_unlock (mutex);
+}
+
+/* reporting */
+
+static void _soak_report (void)
+{
+  FakeBluetoothAudioSinkStatistics fake;
+  SoakStat hold;
+  SoakStat wait;
+
+  fake_bluetoothaudiosink_get_statistics (&fake);
+
+  g_mutex_lock (&soak.lock);
+
+  hold = soak.hold;
+  wait = soak.wait;
+
+  g_mutex_unlock (&soak.lock);
+
+  const guint64 acked = writer.acked;
+  const gint64 lost = ((gint64) acked - (gint64) control.discarded - (gint64) fake.received);
+
+  g_print ("state: %u prepare cycles (%u prepare, %u unprepare failures), %u callbacks delivered, %u disconnections\n",
+           control.cycles, control.prepare_failures, control.unprepare_failures, fake.callbacks, fake.disconnections);
+  g_print ("lock: %" G_GUINT64_FORMAT " times, held %" G_GINT64_FORMAT "us on average, %" G_GINT64_FORMAT "us at most, "
+           "waited for %" G_GINT64_FORMAT "us on average, %" G_GINT64_FORMAT "us at most\n",
+           hold.count, _soak_stat_mean (&hold), hold.max, _soak_stat_mean (&wait), wait.max);
+  g_print ("writes: %" G_GUINT64_FORMAT " bytes acknowledged, %" G_GUINT64_FORMAT " discarded on reset, %" G_GUINT64_FORMAT " received, "
+           "%" G_GINT64_FORMAT " lost; %u write errors (%u frames rejected by the service)\n",
+           acked, control.discarded, fake.received, lost, control.write_errors, fake.rejected);
+  g_print ("resume: %u of %u disconnections, first frame %" G_GINT64_FORMAT "ms after reconnection on average, %" G_GINT64_FORMAT "ms at most; "
+           "resume-time %" G_GINT64_FORMAT "ms on average, %" G_GINT64_FORMAT "ms at most\n",
+           fake.resumes, fake.disconnections, ((fake.resumes != 0)? ((fake.resume_total / fake.resumes) / 1000) : 0), (fake.resume_max / 1000),
+           (_soak_stat_mean (&control.resume_time) / 1000), (control.resume_time.max / 1000));
+}
+
+static gpointer _soak_watchdog (gpointer data)
+{
+  while (!g_atomic_int_get (&control.quit)) {
+    const gchar *stalled = NULL;
+    gint64 held = 0;
+    guint i;
+
+    g_usleep (G_USEC_PER_SEC / 10);
+
+    const gint64 now = g_get_monotonic_time ();
+
+    g_mutex_lock (&soak.lock);
+
+    held = ((soak.held != 0)? (now - soak.held) : 0);
+
+    for (i = 0; i < SOAK_BEATS; i++) {
+      if ((soak.beats[i] != 0) && ((now - soak.beats[i]) > SOAK_STALL_MAX)) {
+        stalled = beat_names[i];
+      }
+    }
+
+    g_mutex_unlock (&soak.lock);
+
+    if ((held > SOAK_HELD_MAX) || (stalled != NULL)) {
+      if (held > SOAK_HELD_MAX) {
+        g_printerr ("DEADLOCK: sink lock held for %" G_GINT64_FORMAT "ms\n", (held / 1000));
+      } else {
+        g_printerr ("DEADLOCK: %s thread stalled\n", stalled);
+      }
+
+      _soak_report ();
+      abort ();
+    }
+  }
+
+  return NULL;
+}
+
+/* writer, standing in for the audio ring buffer thread */
+
+static gpointer _soak_writer (gpointer data)
+{
+  GstAudioSink *sink = GST_AUDIO_SINK (data);
+  GstAudioSinkClass *klass = GST_AUDIO_SINK_GET_CLASS (sink);
+  const guint size = (SOAK_SEGMENT * SOAK_BPF);
+  gint16 *segment = g_new (gint16, (SOAK_SEGMENT * SOAK_CHANNELS));
+  gboolean quit = FALSE;
+  guint i;
+
+  for (i = 0; i < (SOAK_SEGMENT * SOAK_CHANNELS); i++) {
+    segment[i] = (gint16) ((i * 97) & 0x3FFF);
+  }
+
+  while (!quit) {
+    g_mutex_lock (&writer.lock);
+
+    while ((!g_atomic_int_get (&writer.run)) && (!writer.quit)) {
+      writer.idle = TRUE;
+      g_cond_broadcast (&writer.cond);
+
+      _soak_beat (SOAK_BEAT_WRITER, TRUE);
+      g_cond_wait_until (&writer.cond, &writer.lock, (g_get_monotonic_time () + (G_USEC_PER_SEC / 10)));
+    }
+
+    quit = writer.quit;
+    writer.idle = quit;
+
+    g_mutex_unlock (&writer.lock);
+
+    if (!quit) {
+      guint left = size;
+
+      /* Keeps trying until the whole segment is taken, like audioringbuffer_thread_func() does;
+         only reset() gets it out early, by having the sink pretend it was. */
+      while (left > 0) {
+        _soak_beat (SOAK_BEAT_WRITER, TRUE);
+
+        const gint written = klass->write (sink, (((guint8 *) segment) + (size - left)), left);
+
+        if ((written < 0) || (written > (gint) left)) {
+          _soak_fail ("write() returned more than it was given");
+          break;
+        }
+
+        left -= written;
+        writer.acked += written;
+
+        if (written == 0) {
+          g_thread_yield ();
+        }
+      }
+
+      /* As the clock would. */
+      klass->delay (sink);
+    }
+  }
+
+  _soak_beat (SOAK_BEAT_WRITER, FALSE);
+
+  g_free (segment);
+
+  return NULL;
+}
+
+static void _soak_writer_resume (void)
+{
+  g_mutex_lock (&writer.lock);
+
+  g_atomic_int_set (&writer.run, TRUE);
+  g_cond_broadcast (&writer.cond);
+
+  g_mutex_unlock (&writer.lock);
+}
+
+static void _soak_writer_pause (GstAudioSink *sink)
+{
+  g_mutex_lock (&writer.lock);
+
+  g_atomic_int_set (&writer.run, FALSE);
+
+  g_mutex_unlock (&writer.lock);
+
+  /* Unblock the writer, as the ring buffer does when pausing; if this gets lost, the watchdog notices. */
+  GST_AUDIO_SINK_GET_CLASS (sink)->reset (sink);
+
+  g_mutex_lock (&writer.lock);
+
+  while (!writer.idle) {
+    g_cond_wait (&writer.cond, &writer.lock);
+  }
+
+  g_mutex_unlock (&writer.lock);
+}
+
+/* control */
+
+static void _soak_sleep (const guint milliseconds)
+{
+  guint slept = 0;
+
+  while (slept < milliseconds) {
+    const guint nap = MIN (100, (milliseconds - slept));
+
+    _soak_beat (SOAK_BEAT_CONTROL, TRUE);
+    g_usleep (nap * 1000);
+    slept += nap;
+  }
+
+  _soak_beat (SOAK_BEAT_CONTROL, TRUE);
+}
+
+static gboolean _soak_streaming (const gint64 timeout)
+{
+  const gint64 deadline = (g_get_monotonic_time () + timeout);
+  FakeBluetoothAudioSinkStatistics statistics;
+  gboolean result = FALSE;
+
+  fake_bluetoothaudiosink_get_statistics (&statistics);
+
+  const guint64 received = statistics.received;
+
+  while ((!result) && (g_get_monotonic_time () < deadline)) {
+    _soak_sleep (10);
+
+    fake_bluetoothaudiosink_get_statistics (&statistics);
+
+    result = ((fake_bluetoothaudiosink_get_state () == BLUETOOTHAUDIOSINK_STATE_STREAMING)
+                && (statistics.received >= (received + (2 * SOAK_SEGMENT * SOAK_BPF))));
+  }
+
+  return result;
+}
+
+static gboolean _soak_prepare (GstAudioSink *sink)
+{
+  GstAudioRingBufferSpec spec;
+
+  memset (&spec, 0, sizeof (spec));
+
+  gst_audio_info_init (&spec.info);
+  gst_audio_info_set_format (&spec.info, GST_AUDIO_FORMAT_S16LE, SOAK_RATE, SOAK_CHANNELS, NULL);
+
+  spec.type = GST_AUDIO_RING_BUFFER_FORMAT_TYPE_RAW;
+  spec.segsize = (SOAK_SEGMENT * SOAK_BPF);
+  spec.segtotal = 20;
+  spec.latency_time = 10000;
+  spec.buffer_time = (spec.segtotal * spec.latency_time);
+
+  return GST_AUDIO_SINK_GET_CLASS (sink)->prepare (sink, &spec);
+}
+
+static void _soak_collect (GstAudioSink *sink)
+{
+  guint write_errors = 0;
+  guint64 discarded = 0;
+  guint64 resume_time = GST_CLOCK_TIME_NONE;
+
+  /* (Start over on every prepare.) */
+  g_object_get (sink, "write-errors", &write_errors, "discarded-bytes", &discarded, "resume-time", &resume_time, NULL);
+
+  control.write_errors += write_errors;
+  control.discarded += discarded;
+
+  if (GST_CLOCK_TIME_IS_VALID (resume_time)) {
+    _soak_stat_add (&control.resume_time, (gint64) (resume_time / GST_USECOND));
+  }
+}
+
+static gboolean _soak_cycle (GstAudioSink *sink, const guint pause, const guint attempts)
+{
+  gboolean result = FALSE;
+  guint attempt = 0;
+
+  _soak_writer_pause (sink);
+
+  if (!GST_AUDIO_SINK_GET_CLASS (sink)->unprepare (sink)) {
+    control.unprepare_failures++;
+  }
+
+  _soak_collect (sink);
+  _soak_sleep (pause);
+
+  while ((!result) && (attempt < attempts)) {
+    result = _soak_prepare (sink);
+
+    if (!result) {
+      control.prepare_failures++;
+      _soak_sleep (20);
+    }
+
+    attempt++;
+  }
+
+  control.cycles++;
+
+  _soak_writer_resume ();
+
+  return result;
+}
+
+static gpointer _soak_storm (gpointer data)
+{
+  const guint beat = GPOINTER_TO_UINT (data);
+  GRand *rand = g_rand_new_with_seed (beat);
+
+  while (!g_atomic_int_get (&control.calm)) {
+    const gint32 dice = g_rand_int_range (rand, 0, 100);
+
+    _soak_beat (beat, TRUE);
+
+    if (dice < 3) {
+      fake_bluetoothaudiosink_disconnect ();
+      g_usleep (g_rand_int_range (rand, 20, 400) * 1000);
+      fake_bluetoothaudiosink_connect ();
+    } else if (dice < 8) {
+      fake_bluetoothaudiosink_restart ();
+    } else {
+      fake_bluetoothaudiosink_spurious ();
+    }
+
+    g_usleep (g_rand_int_range (rand, 5, 100) * 1000);
+  }
+
+  _soak_beat (beat, FALSE);
+
+  g_rand_free (rand);
+
+  return NULL;
+}
+
+static void _soak_storm_run (GstAudioSink *sink, const guint duration)
+{
+  GThread *storms[SOAK_STORM_THREADS];
+  guint i;
+
+  /* Prepare again straight away, before the service has processed the stop. */
+  for (i = 0; i < SOAK_QUICK_CYCLES; i++) {
+    if (!_soak_cycle (sink, 0, 1)) {
+      _soak_fail ("prepare() failed while the previous stop was in progress");
+    }
+
+    if (!_soak_streaming (SOAK_RESUME_MAX)) {
+      _soak_fail ("playback did not resume after preparing again straight away");
+    }
+  }
+
+  g_print ("quick re-prepare: %u cycles\n", SOAK_QUICK_CYCLES);
+
+  for (i = 0; i < SOAK_STORM_THREADS; i++) {
+    storms[i] = g_thread_new ("soak-storm", &_soak_storm, GUINT_TO_POINTER (SOAK_BEAT_STORM + i));
+  }
+
+  const gint64 end = (g_get_monotonic_time () + (duration * G_USEC_PER_SEC));
+  GRand *rand = g_rand_new_with_seed (0);
+
+  while (g_get_monotonic_time () < end) {
+    _soak_sleep (g_rand_int_range (rand, 20, 300));
+
+    /* (Could fail legitimately if the device drops out meanwhile, so keep trying.) */
+    if (!_soak_cycle (sink, g_rand_int_range (rand, 0, (3 * SOAK_LAG)), 50)) {
+      _soak_fail ("prepare() kept failing during the storm");
+    }
+  }
+
+  g_rand_free (rand);
+
+  g_atomic_int_set (&control.calm, TRUE);
+
+  for (i = 0; i < SOAK_STORM_THREADS; i++) {
+    g_thread_join (storms[i]);
+  }
+
+  /* Everything calm again, so playback must resume by itself. */
+  fake_bluetoothaudiosink_connect ();
+
+  if (!_soak_streaming (2 * SOAK_RESUME_MAX)) {
+    _soak_fail ("playback did not resume after the storm");
+  }
+}
+
+static void _soak_calibration_run (GstElement *element)
+{
+  GstAudioSink *sink = GST_AUDIO_SINK (element);
+  const gint64 deadline = (g_get_monotonic_time () + (SOAK_CALIBRATION_TIME * G_USEC_PER_SEC));
+  const gint64 latency = (SOAK_CALIBRATION_LATENCY * (gint64) GST_MSECOND);
+  const guint64 buffered = ((SOAK_RATE * FAKE_BUFFER_TIME) / 1000);
+  const guint64 corrected = gst_util_uint64_scale_int (latency, SOAK_RATE, GST_SECOND);
+  GstBus *bus = gst_element_get_bus (element);
+  guint measurements = 0;
+  guint batches = 0;
+  gint64 followed = 0;
+
+  /* Each measurement is posted, and every batch of them is folded into the offset posted along with the last one. */
+  while ((batches < SOAK_CALIBRATION_BATCHES) && (g_get_monotonic_time () < deadline)) {
+    GstMessage *message = NULL;
+
+    _soak_sleep (10);
+
+    while ((message = gst_bus_pop_filtered (bus, GST_MESSAGE_ELEMENT)) != NULL) {
+      const GstStructure *structure = gst_message_get_structure (message);
+
+      if ((gst_structure_has_name (structure, "latency-calibration")) && (((++measurements) % SOAK_CALIBRATION_BATCH) == 0)) {
+        gint64 offset = 0;
+
+        gst_structure_get_int64 (structure, "offset", &offset);
+        batches++;
+
+        g_print ("calibration: batch %u, latency-offset %" G_GINT64_FORMAT "ms for a hidden latency of %dms\n",
+                 batches, (offset / (gint64) GST_MSECOND), SOAK_CALIBRATION_LATENCY);
+
+        /* Later batches are measured while the clock slews towards the first offset, and must not overshoot. */
+        if ((offset < (latency - SOAK_CALIBRATION_TOLERANCE)) || (offset > (latency + SOAK_CALIBRATION_TOLERANCE))) {
+          _soak_fail ("latency-offset is off from the hidden latency of the device");
+        }
+
+        if (batches == 1) {
+          /* The clock must not jump to the new offset... */
+          const guint64 delay = GST_AUDIO_SINK_GET_CLASS (sink)->delay (sink);
+
+          g_print ("calibration: delay right after the first update %" G_GUINT64_FORMAT " frames\n", delay);
+
+          if (delay > (buffered + (corrected / 2))) {
+            _soak_fail ("the delay jumped to the new latency-offset");
+          }
+
+          followed = (g_get_monotonic_time () + ((SOAK_CALIBRATION_SLEW + 1000) * (G_USEC_PER_SEC / 1000)));
+        }
+      }
+
+      gst_message_unref (message);
+    }
+  }
+
+  if (batches < SOAK_CALIBRATION_BATCHES) {
+    _soak_fail ("latency-offset was not updated after every batch of measurements");
+  }
+
+  if (batches != 0) {
+    /* ...but follow it gradually. */
+    const gint64 left = (followed - g_get_monotonic_time ());
+
+    if (left > 0) {
+      _soak_sleep ((guint) (left / (G_USEC_PER_SEC / 1000)));
+    }
+
+    const guint64 delay = GST_AUDIO_SINK_GET_CLASS (sink)->delay (sink);
+
+    g_print ("calibration: delay after slewing %" G_GUINT64_FORMAT " frames\n", delay);
+
+    if ((delay < corrected) || (delay > (buffered + corrected + gst_util_uint64_scale_int (SOAK_CALIBRATION_TOLERANCE, SOAK_RATE, GST_SECOND)))) {
+      _soak_fail ("the delay did not follow the new latency-offset");
+    }
+  }
+
+  gst_object_unref (bus);
+}
+
+int main (int argc, char *argv[])
+{
+  const gboolean calibrate = ((argc > 1) && (g_strcmp0 (argv[1], "calibrate") == 0));
+  const guint duration = (((argc > 1) && (!calibrate))? (guint) atoi (argv[1]) : SOAK_DURATION);
+
+  gst_init (&argc, &argv);
+
+  GstElement *element = GST_ELEMENT (gst_object_ref_sink (g_object_new (GST_TYPE_BLUETOOTHAUDIOSINK, NULL)));
+  GstAudioSink *sink = GST_AUDIO_SINK (element);
+  GstAudioSinkClass *klass = GST_AUDIO_SINK_GET_CLASS (sink);
+
+  g_atomic_pointer_set (&soak.watched, &GST_BLUETOOTHAUDIOSINK (element)->lock);
+
+  if (calibrate) {
+    /* Latency the device does not account for in the delay it reports, for calibration to find. */
+    fake_bluetoothaudiosink_set_latency (SOAK_CALIBRATION_LATENCY);
+
+    GstBus *bus = gst_bus_new ();
+
+    gst_element_set_bus (element, bus);
+    gst_object_unref (bus);
+
+    g_object_set (element, "calibrate-latency", TRUE, NULL);
+  }
+
+  fake_bluetoothaudiosink_set_lag (SOAK_LAG);
+  fake_bluetoothaudiosink_connect ();
+
+  GThread *watchdog = g_thread_new ("soak-watchdog", &_soak_watchdog, NULL);
+  GThread *thread = g_thread_new ("soak-writer", &_soak_writer, sink);
+
+  /* Wait for the sink to have registered and the device to have connected. */
+  while ((!fake_bluetoothaudiosink_is_registered ()) || (fake_bluetoothaudiosink_get_state () != BLUETOOTHAUDIOSINK_STATE_CONNECTED)) {
+    _soak_sleep (10);
+  }
+
+  if ((!klass->open (sink)) || (!_soak_prepare (sink))) {
+    _soak_fail ("failed to open and prepare the sink");
+  } else {
+    _soak_writer_resume ();
+
+    if (!_soak_streaming (SOAK_RESUME_MAX)) {
+      _soak_fail ("playback did not start");
+    }
+
+    if (calibrate) {
+      _soak_calibration_run (element);
+    } else {
+      _soak_storm_run (sink, duration);
+    }
+
+    _soak_writer_pause (sink);
+
+    klass->unprepare (sink);
+    _soak_collect (sink);
+    klass->close (sink);
+  }
+
+  g_atomic_int_set (&control.quit, TRUE);
+
+  g_mutex_lock (&writer.lock);
+  writer.quit = TRUE;
+  g_cond_broadcast (&writer.cond);
+  g_mutex_unlock (&writer.lock);
+
+  g_thread_join (thread);
+
+  _soak_beat (SOAK_BEAT_CONTROL, FALSE);
+
+  g_thread_join (watchdog);
+
+  _soak_report ();
+
+  FakeBluetoothAudioSinkStatistics statistics;
+  fake_bluetoothaudiosink_get_statistics (&statistics);
+
+  if (((gint64) writer.acked - (gint64) control.discarded) != (gint64) statistics.received) {
+    _soak_fail ("writes were acknowledged but never handed over to the service");
+  }
+
+  g_atomic_pointer_set (&soak.watched, NULL);
+  gst_object_unref (element);
+
+  return ((g_atomic_int_get (&failures) == 0)? EXIT_SUCCESS : EXIT_FAILURE);
+}
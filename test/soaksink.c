@@ -0,0 +1,30 @@
+/* GStreamer
+ * Copyright (C) 2021 Metrological
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+/* The sink as is, except that its lock goes through the soak test, which times and watches it. */
+
+#include <glib.h>
+
+void soak_mutex_lock (GMutex *mutex);
+void soak_mutex_unlock (GMutex *mutex);
+
+#define g_mutex_lock soak_mutex_lock
+#define g_mutex_unlock soak_mutex_unlock
+
+#include "../gstbluetoothaudiosink.c"